@@ -0,0 +1,249 @@
+#include <gmodel.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <sys/resource.h>
+
+/* usage: gmodel_bench [scenario|all] [n]
+   prints one JSON object per scenario run on stdout, e.g.
+   {"scenario":"balls","n":10,"seconds":0.01,"entities":...,
+    "entities_per_second":...,"allocations":...,"peak_rss_kb":...}
+   allocations counts calls to operator new during the timed part.
+   peak_rss_kb is the peak of the whole process so far, so run one
+   scenario per process when comparing it between releases. */
+
+static std::atomic<long> nallocations(0);
+
+void* operator new(std::size_t size) {
+  ++nallocations;
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+typedef std::chrono::steady_clock Clock;
+
+struct Timer {
+  Clock::time_point start;
+  long allocations;
+  Timer() : start(Clock::now()), allocations(nallocations) {}
+};
+
+static long peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+static void report(char const* scenario, int n, Timer const& timer,
+    std::size_t entities) {
+  auto seconds =
+      std::chrono::duration<double>(Clock::now() - timer.start).count();
+  auto allocations = nallocations - timer.allocations;
+  printf("{\"scenario\":\"%s\",\"n\":%d,\"seconds\":%g,\"entities\":%zu,"
+      "\"entities_per_second\":%g,\"allocations\":%ld,\"peak_rss_kb\":%ld}\n",
+      scenario, n, seconds, entities,
+      seconds > 0 ? double(entities) / seconds : 0.0, allocations,
+      peak_rss_kb());
+  fflush(stdout);
+}
+
+static std::size_t closure_size(gmod::ObjPtr const& obj) {
+  return gmod::get_closure(obj, true, true).size();
+}
+
+static gmod::ObjPtr unit_cube() {
+  return gmod::new_cube(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1});
+}
+
+/* a unit cube holding n^3 ball inclusions */
+static gmod::ObjPtr build_balls(int n) {
+  auto cube = unit_cube();
+  double h = 1.0 / n;
+  std::vector<gmod::ObjPtr> balls;
+  balls.reserve(std::size_t(n) * std::size_t(n) * std::size_t(n));
+  for (int i = 0; i < n; ++i)
+  for (int j = 0; j < n; ++j)
+  for (int k = 0; k < n; ++k) {
+    auto center = gmod::Vector{(i + 0.5) * h, (j + 0.5) * h, (k + 0.5) * h};
+    balls.push_back(gmod::new_ball(center,
+          gmod::Vector{0,0,1}, gmod::Vector{0.3 * h,0,0}));
+  }
+  gmod::insert_many(cube, balls);
+  return cube;
+}
+
+static void bench_balls(int n) {
+  Timer timer;
+  auto cube = build_balls(n);
+  report("balls", n, timer, closure_size(cube));
+}
+
+/* one spline through n^3 points on a helix */
+static void bench_spline(int n) {
+  auto npts = std::size_t(n) * std::size_t(n) * std::size_t(n);
+  std::vector<gmod::Vector> pts(npts);
+  for (std::size_t i = 0; i < npts; ++i) {
+    double t = double(i) / 16.0;
+    pts[i] = gmod::Vector{std::cos(t), std::sin(t), 0.01 * t};
+  }
+  Timer timer;
+  auto spline = gmod::new_spline3(pts);
+  report("spline", n, timer, closure_size(spline));
+}
+
+/* the same helix with its points inline */
+static void bench_spline_inline(int n) {
+  auto npts = std::size_t(n) * std::size_t(n) * std::size_t(n);
+  std::vector<gmod::Vector> pts(npts);
+  for (std::size_t i = 0; i < npts; ++i) {
+    double t = double(i) / 16.0;
+    pts[i] = gmod::Vector{std::cos(t), std::sin(t), 0.01 * t};
+  }
+  Timer timer;
+  auto spline = gmod::new_spline4(pts);
+  report("spline_inline", n, timer,
+      closure_size(spline) + spline->points.size());
+}
+
+/* a disk extruded n^2 times, each time from the previous end face */
+static void bench_extrude_stack(int n) {
+  Timer timer;
+  auto face = gmod::new_disk(gmod::Vector{0,0,0}, gmod::Vector{0,0,1},
+      gmod::Vector{1,0,0});
+  auto group = gmod::new_group();
+  for (int i = 0; i < n * n; ++i) {
+    auto ext = gmod::extrude_face(face, gmod::Vector{0,0,0.1});
+    gmod::add_to_group(group, ext.middle);
+    face = ext.end;
+  }
+  report("extrude_stack", n, timer, closure_size(group));
+}
+
+/* a group of n^2 squares extruded together */
+static void bench_extrude_group(int n) {
+  Timer timer;
+  auto faces = gmod::new_group();
+  for (int i = 0; i < n; ++i)
+  for (int j = 0; j < n; ++j) {
+    gmod::add_to_group(faces, gmod::new_square(
+          gmod::Vector{2.0 * i, 2.0 * j, 0},
+          gmod::Vector{1,0,0}, gmod::Vector{0,1,0}));
+  }
+  auto ext = gmod::extrude_face_group(faces,
+      [](gmod::Vector a) { return a + gmod::Vector{0,0,1}; });
+  report("extrude_group", n, timer, closure_size(ext.middle));
+}
+
+/* n^2 translated copies of a cube with one ball inside */
+static void bench_copy(int n) {
+  auto original = build_balls(1);
+  Timer timer;
+  auto group = gmod::new_group();
+  for (int i = 0; i < n * n; ++i) {
+    auto copy = gmod::copy_closure(original);
+    gmod::transform_closure(copy, gmod::identity_matrix(),
+        gmod::Vector{2.0 * i, 0, 0});
+    gmod::add_to_group(group, copy);
+  }
+  report("copy", n, timer, closure_size(group));
+}
+
+/* .geo and .dmg output of the balls model */
+static void bench_export(int n) {
+  auto cube = build_balls(n);
+  Timer timer;
+  gmod::write_closure_to_geo(cube, "gmodel_bench.geo");
+  gmod::write_closure_to_dmg(cube, "gmodel_bench.dmg");
+  report("export", n, timer, closure_size(cube));
+  remove("gmodel_bench.geo");
+  remove("gmodel_bench.dmg");
+}
+
+/* local feature sizes for the balls model */
+static void bench_sizes(int n) {
+  auto cube = build_balls(n);
+  Timer timer;
+  auto nsized = gmod::assign_sizes(cube, gmod::SizeOptions());
+  report("sizes", n, timer, std::size_t(nsized));
+}
+
+/* the boundary of a group of n^3 separate cubes */
+static void bench_boundary(int n) {
+  auto group = gmod::new_group();
+  for (int i = 0; i < n * n * n; ++i) {
+    gmod::add_to_group(group, gmod::new_cube(
+          gmod::Vector{2.0 * i, 0, 0},
+          gmod::Vector{1,0,0},
+          gmod::Vector{0,1,0},
+          gmod::Vector{0,0,1}));
+  }
+  Timer timer;
+  auto boundary = gmod::collect_assembly_boundary(group);
+  report("boundary", n, timer, boundary->used.size());
+}
+
+/* destruction of an n^3 block grid */
+static void bench_teardown(int n) {
+  auto grid = gmod::new_block_grid(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1},
+      n, n, n);
+  Timer timer;
+  auto destroyed = gmod::release_closure(grid);
+  report("teardown", n, timer, std::size_t(destroyed));
+}
+
+struct Scenario {
+  char const* name;
+  void (*run)(int n);
+};
+
+static Scenario const scenarios[] = {
+    {"balls", bench_balls},
+    {"spline", bench_spline},
+    {"spline_inline", bench_spline_inline},
+    {"extrude_stack", bench_extrude_stack},
+    {"extrude_group", bench_extrude_group},
+    {"copy", bench_copy},
+    {"export", bench_export},
+    {"sizes", bench_sizes},
+    {"boundary", bench_boundary},
+    {"teardown", bench_teardown},
+};
+
+int main(int argc, char** argv) {
+  char const* scenario = (argc > 1) ? argv[1] : "all";
+  int n = (argc > 2) ? atoi(argv[2]) : 10;
+  bool found = false;
+  for (auto const& s : scenarios) {
+    if (strcmp(scenario, "all") && strcmp(scenario, s.name)) continue;
+    s.run(n);
+    found = true;
+  }
+  if (!found) {
+    fprintf(stderr, "unknown scenario \"%s\"\n", scenario);
+    return 1;
+  }
+  /* per-phase totals, when gmodel was built with GMOD_PROFILE */
+  gmod::print_phase_stats(stderr);
+  return 0;
+}
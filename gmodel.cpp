@@ -1,10 +1,23 @@
 #include "gmodel.hpp"
 
-#include <map>
+#include <unordered_map>
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace gmod {
 
@@ -77,177 +90,809 @@ int get_boundary_type(int cell_type) {
   }
 }
 
-static int next_id = 0;
-static int nlive_objects = 0;
+MemoryResource::~MemoryResource() {}
+
+static thread_local MemoryResource* memory_resource = nullptr;
+
+MemoryResource* set_memory_resource(MemoryResource* resource) {
+  auto previous = memory_resource;
+  memory_resource = resource;
+  return previous;
+}
+
+MemoryResource* get_memory_resource() { return memory_resource; }
+
+static void* resource_allocate(MemoryResource* resource, std::size_t bytes,
+    std::size_t alignment) {
+  if (!resource) return ::operator new(bytes);
+  return resource->allocate(bytes, alignment);
+}
+
+static void resource_deallocate(MemoryResource* resource, void* p,
+    std::size_t bytes, std::size_t alignment) {
+  if (!resource) ::operator delete(p);
+  else resource->deallocate(p, bytes, alignment);
+}
+
+/* list storage starts with a header saying where it came from, so
+   SmallVector does not have to carry a resource pointer around */
+struct ListStorageHeader {
+  MemoryResource* resource;
+  std::size_t bytes;
+};
+
+static std::size_t const list_header_bytes =
+    (sizeof(ListStorageHeader) + alignof(std::max_align_t) - 1) /
+    alignof(std::max_align_t) * alignof(std::max_align_t);
+
+void* allocate_list_storage(std::size_t bytes) {
+  auto total = list_header_bytes + bytes;
+  auto block = static_cast<char*>(resource_allocate(memory_resource, total,
+      alignof(std::max_align_t)));
+  new (block) ListStorageHeader{memory_resource, total};
+  return block + list_header_bytes;
+}
+
+void deallocate_list_storage(void* p) {
+  auto block = static_cast<char*>(p) - list_header_bytes;
+  auto header = *reinterpret_cast<ListStorageHeader*>(block);
+  resource_deallocate(header.resource, block, header.bytes,
+      alignof(std::max_align_t));
+}
+
+/* std::allocator interface over a MemoryResource, for allocate_shared */
+template <typename T>
+struct ResourceAllocator {
+  typedef T value_type;
+  MemoryResource* resource;
+  explicit ResourceAllocator(MemoryResource* r) : resource(r) {}
+  template <typename U>
+  ResourceAllocator(ResourceAllocator<U> const& other)
+      : resource(other.resource) {}
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(
+        resource_allocate(resource, n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T* p, std::size_t n) {
+    resource_deallocate(resource, p, n * sizeof(T), alignof(T));
+  }
+};
+
+template <typename T, typename U>
+static bool operator==(ResourceAllocator<T> const& a,
+    ResourceAllocator<U> const& b) {
+  return a.resource == b.resource;
+}
+
+template <typename T, typename U>
+static bool operator!=(ResourceAllocator<T> const& a,
+    ResourceAllocator<U> const& b) {
+  return a.resource != b.resource;
+}
+
+static int num_threads = 1;
+
+void set_num_threads(int n) { num_threads = n; }
+
+int get_num_threads() {
+  if (num_threads > 0) return num_threads;
+  return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+enum {
+  PHASE_EXTRUDE,
+  PHASE_GET_CLOSURE,
+  PHASE_COPY,
+  PHASE_TRANSFORM,
+  PHASE_INSERT,
+  PHASE_WELD,
+  PHASE_ASSEMBLY_BOUNDARY,
+  PHASE_WRITE_GEO,
+  PHASE_WRITE_DMG,
+  PHASE_READ_COORDS,
+  PHASE_ASSIGN_SIZES,
+  NPHASES
+};
+
+static char const* const phase_names[NPHASES] = {
+    "extrude",
+    "get_closure",
+    "copy",
+    "transform",
+    "insert",
+    "weld",
+    "assembly_boundary",
+    "write_geo",
+    "write_dmg",
+    "read_coords",
+    "assign_sizes"};
+
+#ifdef GMOD_PROFILE
+
+typedef std::chrono::steady_clock ProfileClock;
+
+struct TraceEvent {
+  int phase;
+  int thread;
+  ProfileClock::time_point start;
+  ProfileClock::duration duration;
+};
+
+static std::atomic<long> phase_calls[NPHASES];
+static std::atomic<long long> phase_nanoseconds[NPHASES];
+static thread_local int phase_depth[NPHASES];
+static std::atomic<bool> tracing(false);
+static std::mutex trace_mutex;
+static std::vector<TraceEvent> trace_events;
+static ProfileClock::time_point const trace_epoch = ProfileClock::now();
+static std::atomic<int> next_trace_thread(0);
+static thread_local int trace_thread = next_trace_thread++;
+
+class ScopedPhase {
+ public:
+  ScopedPhase(int phase) : phase_(phase), outermost_(!phase_depth[phase]++) {
+    if (outermost_) start_ = ProfileClock::now();
+  }
+  ~ScopedPhase() {
+    --phase_depth[phase_];
+    if (!outermost_) return;
+    auto duration = ProfileClock::now() - start_;
+    ++phase_calls[phase_];
+    phase_nanoseconds[phase_] +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    if (!tracing) return;
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_events.push_back(TraceEvent{phase_, trace_thread, start_, duration});
+  }
+
+ private:
+  int phase_;
+  bool outermost_;
+  ProfileClock::time_point start_;
+};
+
+#define GMOD_PHASE(phase) ScopedPhase gmod_scoped_phase(phase)
+
+/* the phases open on the calling thread, which parallel_for hands to
+   its workers so that their work counts toward the caller's call */
+class OpenPhases {
+ public:
+  OpenPhases() { std::copy(phase_depth, phase_depth + NPHASES, depth_); }
+  void enter() const { std::copy(depth_, depth_ + NPHASES, phase_depth); }
+
+ private:
+  int depth_[NPHASES];
+};
+
+bool profiling_enabled() { return true; }
+
+std::vector<PhaseStats> get_phase_stats() {
+  std::vector<PhaseStats> stats;
+  for (int i = 0; i < NPHASES; ++i) {
+    stats.push_back(PhaseStats{phase_names[i], phase_calls[i],
+        double(phase_nanoseconds[i]) * 1e-9});
+  }
+  return stats;
+}
+
+void reset_phase_stats() {
+  for (int i = 0; i < NPHASES; ++i) {
+    phase_calls[i] = 0;
+    phase_nanoseconds[i] = 0;
+  }
+}
+
+void set_tracing(bool on) { tracing = on; }
+
+void write_chrome_trace(char const* filename) {
+  std::vector<TraceEvent> events;
+  {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    events.swap(trace_events);
+  }
+  FILE* f = fopen(filename, "w");
+  fprintf(f, "{\"traceEvents\":[");
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    auto const& e = events[i];
+    auto ts = std::chrono::duration<double, std::micro>(
+        e.start - trace_epoch).count();
+    auto dur = std::chrono::duration<double, std::micro>(e.duration).count();
+    fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"gmodel\",\"ph\":\"X\","
+        "\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d}",
+        i ? "," : "", phase_names[e.phase], ts, dur, e.thread);
+  }
+  fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(f);
+}
+
+#else
+
+#define GMOD_PHASE(phase)
+
+struct OpenPhases {
+  void enter() const {}
+};
+
+bool profiling_enabled() { return false; }
+
+std::vector<PhaseStats> get_phase_stats() {
+  std::vector<PhaseStats> stats;
+  for (int i = 0; i < NPHASES; ++i)
+    stats.push_back(PhaseStats{phase_names[i], 0, 0.0});
+  return stats;
+}
+
+void reset_phase_stats() {}
+
+void set_tracing(bool) {}
+
+void write_chrome_trace(char const* filename) {
+  FILE* f = fopen(filename, "w");
+  fprintf(f, "{\"traceEvents\":[]}\n");
+  fclose(f);
+}
+
+#endif
+
+/* calls f(i) for i in [0,n), splitting the range over up to
+   get_num_threads() threads. small ranges run serially. */
+template <typename F>
+static void parallel_for(std::size_t n, F const& f) {
+  std::size_t const grain = 256;
+  auto nthreads = std::min(std::size_t(get_num_threads()), n / grain);
+  if (nthreads < 2) {
+    for (std::size_t i = 0; i < n; ++i) f(i);
+    return;
+  }
+  auto chunk = (n + nthreads - 1) / nthreads;
+  auto resource = memory_resource;
+  OpenPhases phases;
+  auto run = [=, &f](std::size_t t) {
+    ScopedMemoryResource scope(resource);
+    phases.enter();
+    auto end = std::min(n, (t + 1) * chunk);
+    for (auto i = t * chunk; i < end; ++i) f(i);
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t t = 1; t < nthreads; ++t) threads.emplace_back(run, t);
+  run(0);
+  for (auto& thread : threads) thread.join();
+}
+
+void print_phase_stats(FILE* f) {
+  for (auto const& stat : get_phase_stats()) {
+    if (!stat.calls) continue;
+    fprintf(f, "%-18s %10ld calls %12.6f s\n", stat.name, stat.calls,
+        stat.seconds);
+  }
+}
+
+static std::atomic<int> next_id(0);
+static std::atomic<int> nlive_objects(0);
+static std::atomic<int> nlive_by_type[NTYPES];
+
+/* when not -1, new objects take their ids from here instead of
+   next_id. parallel stages reserve a block of ids up front and
+   hand each task the ids it would have gotten in serial order. */
+static thread_local int reserved_id = -1;
+
+static int take_id() {
+  if (reserved_id != -1) return reserved_id++;
+  return next_id++;
+}
+
+/* a block of n consecutive ids */
+static int take_ids(int n) {
+  if (reserved_id != -1) {
+    auto first = reserved_id;
+    reserved_id += n;
+    return first;
+  }
+  return next_id.fetch_add(n);
+}
 
-Object::Object(int type_) : type(type_), id(next_id++), scratch(-1) {
+Object::Object(int type_)
+    : type(type_), id(take_id()), scratch(-1), flags(0), revision(0) {
+  assert(0 <= type && type < NTYPES);
   ++nlive_objects;
+  ++nlive_by_type[type];
+}
+
+ObjPtr new_object(int type) {
+  return std::allocate_shared<Object>(
+      ResourceAllocator<Object>(memory_resource), type);
+}
+
+/* objects whose last reference was held by an object being destroyed.
+   they are destroyed one by one by the outermost destructor, so that
+   tearing down a model never recurses more than one level deep. */
+static thread_local std::vector<ObjPtr>* pending_release = nullptr;
+
+/* objects destroyed on this thread, for release_closure */
+static thread_local int ndestroyed = 0;
+
+static void defer_last_reference(ObjPtr& obj, std::vector<ObjPtr>& pending) {
+  if (obj.use_count() == 1) pending.push_back(std::move(obj));
 }
 
-ObjPtr new_object(int type) { return ObjPtr(new Object(type)); }
+Object::~Object() {
+  --nlive_objects;
+  --nlive_by_type[type];
+  ++ndestroyed;
+  std::vector<ObjPtr> pending;
+  auto outermost = (pending_release == nullptr);
+  if (outermost) pending_release = &pending;
+  for (auto& use : used) defer_last_reference(use.obj, *pending_release);
+  for (auto& h : helpers) defer_last_reference(h, *pending_release);
+  for (auto& e : embedded) defer_last_reference(e, *pending_release);
+  if (!outermost) return;
+  while (!pending.empty()) {
+    auto obj = std::move(pending.back());
+    pending.pop_back();
+    obj.reset();
+  }
+  pending_release = nullptr;
+}
 
-Object::~Object() { --nlive_objects; }
+int release_closure(ObjPtr& object) {
+  int before = ndestroyed;
+  object.reset();
+  return ndestroyed - before;
+}
 
-int get_used_dir(ObjPtr user, ObjPtr used) {
+int get_used_dir(ObjPtr const& user, ObjPtr const& used) {
   auto it = std::find_if(user->used.begin(), user->used.end(),
                          [=](Use u) { return u.obj == used; });
   assert(it != user->used.end());
   return it->dir;
 }
 
-std::vector<ObjPtr> get_objs_used(ObjPtr user) {
+std::vector<ObjPtr> get_objs_used(ObjPtr const& user) {
   std::vector<ObjPtr> objs;
-  for (auto use : user->used) objs.push_back(use.obj);
+  for (auto const& use : user->used) objs.push_back(use.obj);
   return objs;
 }
 
-void print_object(FILE* f, ObjPtr obj) {
-  switch (obj->type) {
+/* where the .geo printers write: a file, or the end of a string */
+struct Out {
+  FILE* file;
+  std::string* text;
+};
+
+static void out_printf(Out out, char const* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void out_printf(Out out, char const* format, ...) {
+  va_list args;
+  va_start(args, format);
+  if (!out.text) {
+    vfprintf(out.file, format, args);
+  } else {
+    va_list again;
+    va_copy(again, args);
+    char buf[256];
+    auto n = vsnprintf(buf, sizeof(buf), format, args);
+    if (n < int(sizeof(buf))) {
+      out.text->append(buf, std::size_t(n));
+    } else {
+      auto old = out.text->size();
+      out.text->resize(old + std::size_t(n) + 1);
+      vsnprintf(&(*out.text)[old], std::size_t(n) + 1, format, again);
+      out.text->resize(old + std::size_t(n));
+    }
+    va_end(again);
+  }
+  va_end(args);
+}
+
+/* the .geo and .dmg text of one object is written once, by the
+   format_* templates below, for any view of it: ObjectView reads
+   an Object and FrozenView an object of a Frozen model, so the
+   two sets of writers cannot drift apart. a view has type(), id(),
+   nuses(), use(j), use_dir(j), nhelpers(), helper(j), nembedded(),
+   embedded(j), the pos() and size() of a point, and the ninline()
+   interior points of an inline spline through inline_id(k),
+   inline_pos(k) and inline_size(k). */
+class ObjectView {
+ public:
+  explicit ObjectView(Object const* o) : o_(o) {}
+  int type() const { return o_->type; }
+  int id() const { return o_->id; }
+  int nuses() const { return int(o_->used.size()); }
+  ObjectView use(int j) const {
+    return ObjectView(o_->used[std::size_t(j)].obj.get());
+  }
+  int use_dir(int j) const { return o_->used[std::size_t(j)].dir; }
+  int nhelpers() const { return int(o_->helpers.size()); }
+  ObjectView helper(int j) const {
+    return ObjectView(o_->helpers[std::size_t(j)].get());
+  }
+  int nembedded() const { return int(o_->embedded.size()); }
+  ObjectView embedded(int j) const {
+    return ObjectView(o_->embedded[std::size_t(j)].get());
+  }
+  Vector pos() const { return static_cast<Point const*>(o_)->pos; }
+  double size() const { return static_cast<Point const*>(o_)->size; }
+  int ninline() const {
+    return is_inline_spline(*o_) ? int(spline()->points.size()) : 0;
+  }
+  int inline_id(int k) const { return spline()->first_point_id + k; }
+  Vector inline_pos(int k) const { return spline()->points[std::size_t(k)]; }
+  double inline_size(int) const { return spline()->size; }
+
+ private:
+  Spline const* spline() const { return static_cast<Spline const*>(o_); }
+  Object const* o_;
+};
+
+template <typename View>
+static void format_point(Out f, View const& p) {
+  auto pos = p.pos();
+  out_printf(f, "Point(%u) = {%f,%f,%f,%f};\n", p.id(), pos.x, pos.y, pos.z,
+             p.size());
+}
+
+template <typename View>
+static void format_arc(Out f, View const& arc) {
+  out_printf(f, "%s(%u) = {%u,%u,%u};\n", type_names[arc.type()], arc.id(),
+             arc.use(0).id(), arc.helper(0).id(), arc.use(1).id());
+}
+
+template <typename View>
+static void format_ellipse(Out f, View const& e) {
+  out_printf(f, "%s(%u) = {%u,%u,%u,%u};\n", type_names[e.type()], e.id(),
+             e.use(0).id(), e.helper(0).id(), e.helper(1).id(),
+             e.use(1).id());
+}
+
+template <typename View>
+static void format_spline(Out f, View const& e) {
+  auto n = e.ninline();
+  for (int k = 0; k < n; ++k) {
+    auto p = e.inline_pos(k);
+    out_printf(f, "Point(%u) = {%f,%f,%f,%f};\n", e.inline_id(k), p.x, p.y,
+               p.z, e.inline_size(k));
+  }
+  out_printf(f, "%s(%u) = {%u,", type_names[e.type()], e.id(),
+             e.use(0).id());
+  for (int j = 0; j < e.nhelpers(); ++j)
+    out_printf(f, "%u,", e.helper(j).id());
+  for (int k = 0; k < n; ++k) out_printf(f, "%u,", e.inline_id(k));
+  out_printf(f, "%u};\n", e.use(1).id());
+}
+
+template <typename View>
+static void format_simple_object(Out f, View const& obj) {
+  out_printf(f, "%s(%d) = {", type_names[obj.type()], obj.id());
+  for (int j = 0; j < obj.nuses(); ++j) {
+    if (j) out_printf(f, ",");
+    if (is_boundary(obj.type()) && obj.use_dir(j) == REVERSE)
+      out_printf(f, "%d", -obj.use(j).id());
+    else
+      out_printf(f, "%u", obj.use(j).id());
+  }
+  out_printf(f, "};\n");
+  for (int j = 0; j < obj.nembedded(); ++j) {
+    auto emb = obj.embedded(j);
+    out_printf(f, "%s{%d} In %s{%d};\n",
+        dim_names[type_dims[emb.type()]], emb.id(),
+        dim_names[type_dims[obj.type()]], obj.id());
+  }
+}
+
+template <typename View>
+static void format_object(Out f, View const& obj) {
+  switch (obj.type()) {
     case POINT:
-      print_point(f, std::dynamic_pointer_cast<Point>(obj));
+      format_point(f, obj);
       break;
     case ARC:
-      print_arc(f, obj);
+      format_arc(f, obj);
       break;
     case ELLIPSE:
-      print_ellipse(f, obj);
+      format_ellipse(f, obj);
       break;
     case SPLINE:
-      print_spline(f, obj);
+      format_spline(f, obj);
       break;
     case GROUP:
       break;
     default:
-      print_simple_object(f, obj);
+      format_simple_object(f, obj);
+      break;
+  }
+}
+
+template <typename View>
+static void format_object_physical(Out f, View const& obj) {
+  if (!is_entity(obj.type())) return;
+  out_printf(f, "%s(%u) = {%u};\n", physical_type_names[obj.type()],
+             obj.id(), obj.id());
+}
+
+template <typename View>
+static void format_object_dmg(Out f, View const& obj) {
+  switch (obj.type()) {
+    case POINT: {
+      auto pos = obj.pos();
+      out_printf(f, "%u %f %f %f\n", obj.id(), pos.x, pos.y, pos.z);
+    } break;
+    case LINE:
+    case ARC:
+    case SPLINE:
+    case ELLIPSE:
+      out_printf(f, "%u %u %u\n", obj.id(), obj.use(0).id(),
+                 obj.use(1).id());
+      break;
+    case PLANE:
+    case RULED:
+    case VOLUME: {
+      out_printf(f, "%u %d\n", obj.id(), obj.nuses());
+      for (int j = 0; j < obj.nuses(); ++j) {
+        auto bnd = obj.use(j);
+        out_printf(f, " %d\n", bnd.nuses());
+        for (int k = 0; k < bnd.nuses(); ++k)
+          out_printf(f, "  %u %u\n", bnd.use(k).id(), !bnd.use_dir(k));
+      }
+    } break;
+    default:
       break;
   }
 }
 
-void print_object_physical(FILE* f, ObjPtr obj) {
-  if (!is_entity(obj->type)) return;
-  fprintf(f, "%s(%u) = {%u};\n", physical_type_names[obj->type], obj->id,
-          obj->id);
+static void format_object(Out f, ObjPtr const& obj) {
+  format_object(f, ObjectView(obj.get()));
+}
+
+static void format_object_physical(Out f, ObjPtr const& obj) {
+  format_object_physical(f, ObjectView(obj.get()));
+}
+
+void print_object(FILE* f, ObjPtr const& obj) {
+  format_object(Out{f, nullptr}, obj);
+}
+
+void print_object_physical(FILE* f, ObjPtr const& obj) {
+  format_object_physical(Out{f, nullptr}, obj);
 }
 
-void print_closure(FILE* f, ObjPtr obj) {
+void print_closure(FILE* f, ObjPtr const& obj) {
+  GMOD_PHASE(PHASE_WRITE_GEO);
   auto closure = get_closure(obj, true, true);
-  for (auto co : closure) print_object(f, co);
+  for (auto const& co : closure) print_object(f, co);
   closure = get_closure(obj, false, true);
-  for (auto co : closure) print_object_physical(f, co);
+  for (auto const& co : closure) print_object_physical(f, co);
 }
 
-void write_closure_to_geo(ObjPtr obj, char const* filename) {
+void write_closure_to_geo(ObjPtr const& obj, char const* filename) {
   FILE* f = fopen(filename, "w");
   print_closure(f, obj);
   fclose(f);
 }
 
-void print_simple_object(FILE* f, ObjPtr obj) {
-  fprintf(f, "%s(%d) = {", type_names[obj->type], obj->id);
-  bool first = true;
-  for (auto use : obj->used) {
-    if (!first) fprintf(f, ",");
-    if (is_boundary(obj->type) && use.dir == REVERSE)
-      fprintf(f, "%d", -(int(use.obj->id)));
-    else
-      fprintf(f, "%u", use.obj->id);
-    if (first) first = false;
+GeoCache::GeoCache() : pass(0), nformatted(0) {}
+
+static bool is_current(GeoCache::Entry const& entry, Object const& obj) {
+  if (entry.type != obj.type || entry.revision != obj.revision) return false;
+  if (obj.type != POINT) return true;
+  auto& p = static_cast<Point const&>(obj);
+  return entry.x == p.pos.x && entry.y == p.pos.y && entry.z == p.pos.z &&
+         entry.size == p.size;
+}
+
+void print_closure(FILE* f, ObjPtr const& obj, GeoCache& cache) {
+  GMOD_PHASE(PHASE_WRITE_GEO);
+  ++cache.pass;
+  cache.nformatted = 0;
+  for (auto const& co : get_closure(obj, true, true)) {
+    auto& entry = cache.entries[co->id];
+    if (entry.pass == 0 || !is_current(entry, *co)) {
+      entry.type = co->type;
+      entry.revision = co->revision;
+      if (co->type == POINT) {
+        auto p = object_cast<Point>(co.get());
+        entry.x = p->pos.x;
+        entry.y = p->pos.y;
+        entry.z = p->pos.z;
+        entry.size = p->size;
+      }
+      entry.text.clear();
+      entry.physical.clear();
+      format_object(Out{nullptr, &entry.text}, co);
+      format_object_physical(Out{nullptr, &entry.physical}, co);
+      ++cache.nformatted;
+    }
+    entry.pass = cache.pass;
+    fputs(entry.text.c_str(), f);
   }
-  fprintf(f, "};\n");
-  for (auto emb : obj->embedded) {
-    fprintf(f, "%s{%d} In %s{%d};\n",
-        dim_names[type_dims[emb->type]], emb->id,
-        dim_names[type_dims[obj->type]], obj->id);
+  for (auto const& co : get_closure(obj, false, true))
+    fputs(cache.entries[co->id].physical.c_str(), f);
+  for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+    if (it->second.pass != cache.pass) it = cache.entries.erase(it);
+    else ++it;
   }
 }
 
-void print_object_dmg(FILE* f, ObjPtr obj) {
-  switch (obj->type) {
-    case POINT: {
-      PointPtr p = std::dynamic_pointer_cast<Point>(obj);
-      fprintf(f, "%u %f %f %f\n", obj->id, p->pos.x, p->pos.y, p->pos.z);
-    } break;
-    case LINE:
-    case ARC:
-    case SPLINE:
-    case ELLIPSE: {
-      fprintf(f, "%u %u %u\n", obj->id, edge_point(obj, 0)->id,
-              edge_point(obj, 1)->id);
-    } break;
-    case PLANE:
-    case RULED:
-    case VOLUME: {
-      fprintf(f, "%u %zu\n", obj->id, obj->used.size());
-      for (auto use : obj->used) {
-        auto bnd = use.obj;
-        fprintf(f, " %zu\n", bnd->used.size());
-        for (auto bu : bnd->used) {
-          fprintf(f, "  %u %u\n", bu.obj->id, !bu.dir);
-        }
-      }
-    } break;
-    case LOOP:
-    case SHELL:
-    case GROUP:
-      break;
-  }
+void write_closure_to_geo(ObjPtr const& obj, char const* filename,
+    GeoCache& cache) {
+  FILE* f = fopen(filename, "w");
+  print_closure(f, obj, cache);
+  fclose(f);
+}
+
+void print_simple_object(FILE* f, ObjPtr const& obj) {
+  format_simple_object(Out{f, nullptr}, ObjectView(obj.get()));
+}
+
+void print_object_dmg(FILE* f, ObjPtr const& obj) {
+  format_object_dmg(Out{f, nullptr}, ObjectView(obj.get()));
 }
 
 int count_of_type(std::vector<ObjPtr> const& objs, int type) {
   int c = 0;
-  for (auto obj : objs)
+  for (auto const& obj : objs)
     if (obj->type == type) ++c;
   return c;
 }
 
 int count_of_dim(std::vector<ObjPtr> const& objs, int dim) {
   int c = 0;
-  for (int i = 0; i < NTYPES; ++i)
-    if (is_entity(i) && type_dims[i] == dim) c += count_of_type(objs, i);
+  for (auto const& obj : objs)
+    if (is_entity(obj->type) && type_dims[obj->type] == dim) ++c;
   return c;
 }
 
-void print_closure_dmg(FILE* f, ObjPtr obj) {
+void print_closure_dmg(FILE* f, ObjPtr const& obj) {
+  GMOD_PHASE(PHASE_WRITE_DMG);
   auto closure = get_closure(obj, false, true);
-  fprintf(f, "%u %u %u %u\n", count_of_dim(closure, 3),
-          count_of_dim(closure, 2), count_of_dim(closure, 1),
-          count_of_dim(closure, 0));
+  int counts[4] = {0, 0, 0, 0};
+  for (auto const& co : closure)
+    if (is_entity(co->type)) ++counts[type_dims[co->type]];
+  fprintf(f, "%u %u %u %u\n", counts[3], counts[2], counts[1], counts[0]);
   fprintf(f, "0 0 0\n0 0 0\n");
   for (int d = 0; d <= 3; ++d) {
     auto d_objs = filter_by_dim(closure, d);
-    for (auto d_obj : d_objs) print_object_dmg(f, d_obj);
+    for (auto const& d_obj : d_objs) print_object_dmg(f, d_obj);
   }
 }
 
-void write_closure_to_dmg(ObjPtr obj, char const* filename) {
+void write_closure_to_dmg(ObjPtr const& obj, char const* filename) {
   FILE* f = fopen(filename, "w");
   print_closure_dmg(f, obj);
   fclose(f);
 }
 
-void add_use(ObjPtr by, int dir, ObjPtr of) {
+/* a guess at the shared_ptr control block allocate_shared puts
+   next to each object: two counts, a vtable pointer and the
+   allocator */
+static std::size_t const control_block_bytes = 4 * sizeof(void*);
+
+template <typename T, std::size_t N>
+static std::size_t heap_bytes(SmallVector<T, N> const& v) {
+  return v.is_inline() ? 0 : v.capacity() * sizeof(T);
+}
+
+ModelStats model_stats(ObjPtr const& root) {
+  ModelStats stats = ModelStats();
+  for (auto const& obj : get_closure(root, true, true)) {
+    ++stats.nobjects;
+    assert(0 <= obj->type && obj->type < NTYPES);
+    ++stats.count_by_type[obj->type];
+    if (is_entity(obj->type)) ++stats.count_by_dim[type_dims[obj->type]];
+    stats.nuses += long(obj->used.size());
+    stats.nhelpers += long(obj->helpers.size());
+    stats.nembedded += long(obj->embedded.size());
+    if (!obj->used.is_inline() || !obj->helpers.is_inline() ||
+        !obj->embedded.is_inline()) {
+      ++stats.nspilled;
+    }
+    if (obj->type == POINT) {
+      stats.bytes += sizeof(Point);
+    } else if (is_inline_spline(*obj)) {
+      auto spline = object_cast<Spline>(obj.get());
+      stats.ninline_points += int(spline->points.size());
+      stats.bytes += sizeof(Spline);
+      stats.bytes += spline->points.capacity() * sizeof(Vector);
+    } else if (is_extruded_volume(*obj)) {
+      stats.bytes += sizeof(ExtrudedVolume);
+    } else {
+      stats.bytes += sizeof(Object);
+    }
+    stats.bytes += control_block_bytes;
+    stats.bytes += heap_bytes(obj->used);
+    stats.bytes += heap_bytes(obj->helpers);
+    stats.bytes += heap_bytes(obj->embedded);
+  }
+  return stats;
+}
+
+LiveStats live_stats() {
+  LiveStats stats;
+  stats.nobjects = nlive_objects;
+  for (int i = 0; i < NTYPES; ++i) stats.count_by_type[i] = nlive_by_type[i];
+  return stats;
+}
+
+GeoStream open_geo_stream(char const* filename) {
+  GeoStream stream;
+  stream.file = fopen(filename, "w");
+  if (!stream.file) {
+    fprintf(stderr, "could not open %s for writing\n", filename);
+    abort();
+  }
+  return stream;
+}
+
+/* streamed objects have no uses or helpers left, so these
+   traversals stop at them and only visit the new front */
+void stream_closure(GeoStream& stream, ObjPtr const& obj) {
+  GMOD_PHASE(PHASE_WRITE_GEO);
+  if (obj->flags & OBJECT_STREAMED) return;
+  auto closure = get_closure(obj, true, true);
+  for (auto const& co : closure) {
+    if (!(co->flags & OBJECT_STREAMED)) print_object(stream.file, co);
+  }
+  for (auto const& co : get_closure(obj, false, true)) {
+    if (co->flags & OBJECT_STREAMED_PHYSICAL) continue;
+    print_object_physical(stream.file, co);
+    co->flags |= OBJECT_STREAMED_PHYSICAL;
+  }
+  for (auto const& co : closure) {
+    if (co->flags & OBJECT_STREAMED) continue;
+    co->flags |= OBJECT_STREAMED;
+    co->used.clear();
+    co->helpers.clear();
+    co->embedded.clear();
+    if (is_inline_spline(*co)) {
+      auto spline = object_cast<Spline>(co.get());
+      spline->points.clear();
+      spline->points.shrink_to_fit();
+    }
+  }
+}
+
+void close_geo_stream(GeoStream& stream, ObjPtr const& root) {
+  stream_closure(stream, root);
+  fclose(stream.file);
+  stream.file = nullptr;
+}
+
+void add_use(ObjPtr const& by, int dir, ObjPtr const& of) {
   by->used.push_back(Use{dir, of});
+  ++by->revision;
+}
+
+void add_helper(ObjPtr const& to, ObjPtr const& h) {
+  to->helpers.push_back(h);
+  ++to->revision;
 }
 
-void add_helper(ObjPtr to, ObjPtr h) { to->helpers.push_back(h); }
+void mark_changed(ObjPtr const& obj) { ++obj->revision; }
+
+void mark_transfinite(ObjPtr const& obj) {
+  assert(is_face(obj->type) || obj->type == VOLUME);
+  obj->flags |= OBJECT_TRANSFINITE;
+  ++obj->revision;
+}
 
-std::vector<ObjPtr> get_closure(ObjPtr obj, bool include_helpers,
+std::vector<ObjPtr> get_closure(ObjPtr const& obj, bool include_helpers,
     bool include_embedded) {
+  GMOD_PHASE(PHASE_GET_CLOSURE);
   std::vector<ObjPtr> queue;
   queue.reserve(std::size_t(nlive_objects));
   std::size_t first = 0;
   queue.push_back(obj);
   while (first != queue.size()) {
-    ObjPtr current = queue[first++];
-    for (auto use : current->used) {
-      auto child = use.obj;
+    Object* current = queue[first++].get();
+    for (auto const& use : current->used) {
+      auto const& child = use.obj;
       if (child->scratch == -1) {
         child->scratch = 1;
         queue.push_back(child);
       }
     }
     if (include_helpers) {
-      for (auto child : current->helpers) {
+      for (auto const& child : current->helpers) {
         if (child->scratch == -1) {
           child->scratch = 1;
           queue.push_back(child);
@@ -255,7 +900,7 @@ std::vector<ObjPtr> get_closure(ObjPtr obj, bool include_helpers,
       }
     }
     if (include_embedded) {
-      for (auto child : current->embedded) {
+      for (auto const& child : current->embedded) {
         if (child->scratch == -1) {
           child->scratch = 1;
           queue.push_back(child);
@@ -270,15 +915,15 @@ std::vector<ObjPtr> get_closure(ObjPtr obj, bool include_helpers,
 
 std::vector<ObjPtr> filter_by_dim(std::vector<ObjPtr> const& objs, int dim) {
   std::vector<ObjPtr> out;
-  for (auto obj : objs) if (type_dims[obj->type] == dim) out.push_back(obj);
+  for (auto const& obj : objs) if (type_dims[obj->type] == dim) out.push_back(obj);
   return out;
 }
 
 std::vector<PointPtr> filter_points(std::vector<ObjPtr> const& objs) {
   auto point_objs = filter_by_dim(objs, 0);
   std::vector<PointPtr> points;
-  for (auto obj : point_objs) {
-    points.push_back(std::dynamic_pointer_cast<Point>(obj));
+  for (auto const& obj : point_objs) {
+    points.push_back(object_cast<Point>(obj));
   }
   return points;
 }
@@ -287,7 +932,9 @@ Point::Point() : Object(POINT) {}
 
 Point::~Point() {}
 
-PointPtr new_point() { return PointPtr(new Point()); }
+PointPtr new_point() {
+  return std::allocate_shared<Point>(ResourceAllocator<Point>(memory_resource));
+}
 
 double default_size = 0.1;
 
@@ -311,9 +958,8 @@ std::vector<PointPtr> new_points(std::vector<Vector> vs) {
   return out;
 }
 
-void print_point(FILE* f, PointPtr p) {
-  fprintf(f, "Point(%u) = {%f,%f,%f,%f};\n", p->id, p->pos.x, p->pos.y,
-          p->pos.z, p->size);
+void print_point(FILE* f, PointPtr const& p) {
+  format_point(Out{f, nullptr}, ObjectView(p.get()));
 }
 
 Extruded extrude_point(PointPtr start, Vector v) {
@@ -321,6 +967,7 @@ Extruded extrude_point(PointPtr start, Vector v) {
 }
 
 Extruded extrude_point2(PointPtr start, Transform tr) {
+  GMOD_PHASE(PHASE_EXTRUDE);
   PointPtr end = new_point3(tr(start->pos), start->size);
   ObjPtr middle = new_line2(start, end);
   return Extruded{middle, end};
@@ -328,6 +975,7 @@ Extruded extrude_point2(PointPtr start, Transform tr) {
 
 std::vector<Extruded> extrude_points(std::vector<PointPtr> const& points,
     Transform tr) {
+  GMOD_PHASE(PHASE_EXTRUDE);
   std::vector<Extruded> extrusions;
   int i = 0;
   for (auto point : points) {
@@ -337,9 +985,12 @@ std::vector<Extruded> extrude_points(std::vector<PointPtr> const& points,
   return extrusions;
 }
 
-PointPtr edge_point(ObjPtr edge, int i) {
-  auto o = edge->used[std::size_t(i)].obj;
-  return std::dynamic_pointer_cast<Point>(o);
+PointPtr edge_point(ObjPtr const& edge, int i) {
+  return object_cast<Point>(edge->used[std::size_t(i)].obj);
+}
+
+PointHandle edge_point(ObjHandle edge, int i) {
+  return PointHandle(edge->used[std::size_t(i)].obj);
 }
 
 ObjPtr new_line() { return new_object(LINE); }
@@ -369,19 +1020,20 @@ ObjPtr new_arc2(PointPtr start, PointPtr center, PointPtr end) {
   return a;
 }
 
-PointPtr arc_center(ObjPtr arc) {
-  return std::dynamic_pointer_cast<Point>(arc->helpers[0]);
+PointPtr arc_center(ObjPtr const& arc) {
+  return object_cast<Point>(arc->helpers[0]);
 }
 
-Vector arc_normal(ObjPtr arc) {
+PointHandle arc_center(ObjHandle arc) { return PointHandle(arc->helpers[0]); }
+
+Vector arc_normal(ObjPtr const& arc) {
   return normalize_vector(cross_product(
       subtract_vectors(edge_point(arc, 0)->pos, arc_center(arc)->pos),
       subtract_vectors(edge_point(arc, 1)->pos, arc_center(arc)->pos)));
 }
 
-void print_arc(FILE* f, ObjPtr arc) {
-  fprintf(f, "%s(%u) = {%u,%u,%u};\n", type_names[arc->type], arc->id,
-          edge_point(arc, 0)->id, arc_center(arc)->id, edge_point(arc, 1)->id);
+void print_arc(FILE* f, ObjPtr const& arc) {
+  format_arc(Out{f, nullptr}, ObjectView(arc.get()));
 }
 
 ObjPtr new_ellipse() { return new_object(ELLIPSE); }
@@ -396,18 +1048,22 @@ ObjPtr new_ellipse2(PointPtr start, PointPtr center, PointPtr major_pt,
   return e;
 }
 
-PointPtr ellipse_center(ObjPtr e) {
-  return std::dynamic_pointer_cast<Point>(e->helpers[0]);
+PointPtr ellipse_center(ObjPtr const& e) {
+  return object_cast<Point>(e->helpers[0]);
+}
+
+PointHandle ellipse_center(ObjHandle e) { return PointHandle(e->helpers[0]); }
+
+PointPtr ellipse_major_pt(ObjPtr const& e) {
+  return object_cast<Point>(e->helpers[1]);
 }
 
-PointPtr ellipse_major_pt(ObjPtr e) {
-  return std::dynamic_pointer_cast<Point>(e->helpers[1]);
+PointHandle ellipse_major_pt(ObjHandle e) {
+  return PointHandle(e->helpers[1]);
 }
 
-void print_ellipse(FILE* f, ObjPtr e) {
-  fprintf(f, "%s(%u) = {%u,%u,%u,%u};\n", type_names[e->type], e->id,
-          edge_point(e, 0)->id, ellipse_center(e)->id, ellipse_major_pt(e)->id,
-          edge_point(e, 1)->id);
+void print_ellipse(FILE* f, ObjPtr const& e) {
+  format_ellipse(Out{f, nullptr}, ObjectView(e.get()));
 }
 
 ObjPtr new_spline() { return new_object(SPLINE); }
@@ -427,10 +1083,33 @@ ObjPtr new_spline3(std::vector<Vector> const& pts) {
   return new_spline2(pts2);
 }
 
-void print_spline(FILE* f, ObjPtr e) {
-  fprintf(f, "%s(%u) = {%u,", type_names[e->type], e->id, edge_point(e, 0)->id);
-  for (auto h : e->helpers) fprintf(f, "%u,", h->id);
-  fprintf(f, "%u};\n", edge_point(e, 1)->id);
+Spline::Spline() : Object(SPLINE), size(default_size), first_point_id(-1) {
+  flags |= OBJECT_INLINE_SPLINE;
+}
+
+Spline::~Spline() {}
+
+SplinePtr new_spline4(std::vector<Vector> const& pts) {
+  assert(pts.size() >= 2);
+  auto start = new_point2(pts.front());
+  std::vector<Vector> interior(pts.begin() + 1, pts.end() - 1);
+  auto end = new_point2(pts.back());
+  return new_spline5(start, interior, end);
+}
+
+SplinePtr new_spline5(PointPtr start, std::vector<Vector> const& interior,
+    PointPtr end) {
+  auto e = std::allocate_shared<Spline>(
+      ResourceAllocator<Spline>(memory_resource));
+  e->points.assign(interior.begin(), interior.end());
+  e->first_point_id = take_ids(int(interior.size()));
+  add_use(e, FORWARD, start);
+  add_use(e, FORWARD, end);
+  return e;
+}
+
+void print_spline(FILE* f, ObjPtr const& e) {
+  format_spline(Out{f, nullptr}, ObjectView(e.get()));
 }
 
 Extruded extrude_edge(ObjPtr start, Vector v) {
@@ -444,22 +1123,23 @@ Extruded extrude_edge2(ObjPtr start, Vector v, Extruded left, Extruded right) {
 }
 
 Extruded extrude_edge3(ObjPtr start, Transform tr, Extruded left, Extruded right) {
+  GMOD_PHASE(PHASE_EXTRUDE);
   auto loop = new_loop();
   add_use(loop, FORWARD, start);
   add_use(loop, FORWARD, right.middle);
   ObjPtr end = nullptr;
   switch (start->type) {
     case LINE: {
-      end = new_line2(std::dynamic_pointer_cast<Point>(left.end),
-                      std::dynamic_pointer_cast<Point>(right.end));
+      end = new_line2(object_cast<Point>(left.end),
+                      object_cast<Point>(right.end));
       break;
     }
     case ARC: {
       PointPtr start_center = arc_center(start);
       PointPtr end_center =
           new_point3(tr(start_center->pos), start_center->size);
-      end = new_arc2(std::dynamic_pointer_cast<Point>(left.end), end_center,
-                     std::dynamic_pointer_cast<Point>(right.end));
+      end = new_arc2(object_cast<Point>(left.end), end_center,
+                     object_cast<Point>(right.end));
       break;
     }
     case ELLIPSE: {
@@ -469,20 +1149,31 @@ Extruded extrude_edge3(ObjPtr start, Transform tr, Extruded left, Extruded right
       PointPtr start_major_pt = ellipse_major_pt(start);
       PointPtr end_major_pt =
           new_point3(tr(start_major_pt->pos), start_major_pt->size);
-      end = new_ellipse2(std::dynamic_pointer_cast<Point>(left.end), end_center,
+      end = new_ellipse2(object_cast<Point>(left.end), end_center,
                          end_major_pt,
-                         std::dynamic_pointer_cast<Point>(right.end));
+                         object_cast<Point>(right.end));
       break;
     }
     case SPLINE: {
+      if (is_inline_spline(*start)) {
+        auto spline = object_cast<Spline>(start.get());
+        std::vector<Vector> end_interior;
+        end_interior.reserve(spline->points.size());
+        for (auto const& p : spline->points) end_interior.push_back(tr(p));
+        auto end_spline = new_spline5(object_cast<Point>(left.end),
+            end_interior, object_cast<Point>(right.end));
+        end_spline->size = spline->size;
+        end = end_spline;
+        break;
+      }
       std::vector<PointPtr> end_pts;
-      end_pts.push_back(std::dynamic_pointer_cast<Point>(left.end));
-      for (auto h : start->helpers) {
-        auto start_h = std::dynamic_pointer_cast<Point>(h);
+      end_pts.push_back(object_cast<Point>(left.end));
+      for (auto const& h : start->helpers) {
+        auto start_h = object_cast<Point>(h);
         auto end_h = new_point3(tr(start_h->pos), start_h->size);
         end_pts.push_back(end_h);
       }
-      end_pts.push_back(std::dynamic_pointer_cast<Point>(right.end));
+      end_pts.push_back(object_cast<Point>(right.end));
       end = new_spline2(end_pts);
       break;
     }
@@ -506,14 +1197,16 @@ Extruded extrude_edge3(ObjPtr start, Transform tr, Extruded left, Extruded right
       middle = nullptr;
       break;
   }
+  if (middle) middle->flags |= OBJECT_TRANSFINITE;
   return Extruded{middle, end};
 }
 
 std::vector<Extruded> extrude_edges(std::vector<ObjPtr> const& edges,
     Transform tr, std::vector<Extruded> const& point_extrusions) {
+  GMOD_PHASE(PHASE_EXTRUDE);
   std::vector<Extruded> edge_extrusions;
   int i = 0;
-  for (auto edge : edges) {
+  for (auto const& edge : edges) {
     edge_extrusions.push_back(
         extrude_edge3(edge, tr,
           at(point_extrusions, edge_point(edge, 0)->scratch),
@@ -525,9 +1218,9 @@ std::vector<Extruded> extrude_edges(std::vector<ObjPtr> const& edges,
 
 ObjPtr new_loop() { return new_object(LOOP); }
 
-std::vector<PointPtr> loop_points(ObjPtr loop) {
+std::vector<PointPtr> loop_points(ObjPtr const& loop) {
   std::vector<PointPtr> points;
-  for (auto use : loop->used) points.push_back(edge_point(use.obj, use.dir));
+  for (auto const& use : loop->used) points.push_back(edge_point(use.obj, use.dir));
   return points;
 }
 
@@ -541,24 +1234,26 @@ Extruded extrude_loop2(ObjPtr start, Vector v, ObjPtr shell, int shell_dir) {
 }
 
 Extruded extrude_loop3(ObjPtr start, Transform tr, ObjPtr shell, int shell_dir) {
+  GMOD_PHASE(PHASE_EXTRUDE);
   ObjPtr end = new_loop();
   auto start_points = loop_points(start);
   auto start_edges = get_objs_used(start);
   auto point_extrusions = extrude_points(start_points, tr);
   auto edge_extrusions = extrude_edges(start_edges, tr, point_extrusions);
   auto result = extrude_loop4(start, shell, shell_dir, edge_extrusions);
-  for (auto obj : start_points) obj->scratch = -1;
-  for (auto obj : start_edges) obj->scratch = -1;
+  for (auto const& obj : start_points) obj->scratch = -1;
+  for (auto const& obj : start_edges) obj->scratch = -1;
   return result;
 }
 
 Extruded extrude_loop4(ObjPtr start, ObjPtr shell, int shell_dir,
     std::vector<Extruded> const& edge_extrusions) {
+  GMOD_PHASE(PHASE_EXTRUDE);
   ObjPtr end = new_loop();
-  for (auto use : start->used) {
+  for (auto const& use : start->used) {
     add_use(end, use.dir, at(edge_extrusions, use.obj->scratch).end);
   }
-  for (auto use : start->used) {
+  for (auto const& use : start->used) {
     add_use(shell, use.dir ^ shell_dir,
         at(edge_extrusions, use.obj->scratch).middle);
   }
@@ -611,6 +1306,176 @@ ObjPtr new_polyline2(std::vector<Vector> const& vs) {
   return new_polyline(new_points(vs));
 }
 
+static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static double const exact_powers_of_ten[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5,
+    1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+    1e18, 1e19, 1e20, 1e21, 1e22};
+
+/* parses one number at p, not reading past end. a mantissa of up
+   to 15 digits scaled by a power of ten up to 22 is two exact
+   doubles, so their product or quotient is correctly rounded and
+   needs no strtod. anything else goes to strtod. returns p itself
+   if there is no number there. */
+static char const* parse_number(char const* p, char const* end, double* out) {
+  auto start = p;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+  std::uint64_t mantissa = 0;
+  int ndigits = 0;
+  int exponent = 0;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p, ++ndigits)
+    mantissa = mantissa * 10 + std::uint64_t(*p - '0');
+  if (p != end && *p == '.') {
+    for (++p; p != end && *p >= '0' && *p <= '9'; ++p, ++ndigits) {
+      mantissa = mantissa * 10 + std::uint64_t(*p - '0');
+      --exponent;
+    }
+  }
+  if (ndigits == 0) return start;
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    auto q = p + 1;
+    bool negative_exponent = false;
+    if (q != end && (*q == '-' || *q == '+'))
+      negative_exponent = (*q++ == '-');
+    if (q != end && *q >= '0' && *q <= '9') {
+      int e = 0;
+      for (; q != end && *q >= '0' && *q <= '9'; ++q)
+        if (e < 10000) e = e * 10 + (*q - '0');
+      exponent += negative_exponent ? -e : e;
+      p = q;
+    }
+  }
+  if (ndigits <= 15 && exponent >= -22 && exponent <= 22) {
+    double value = double(mantissa);
+    if (exponent < 0) value /= exact_powers_of_ten[-exponent];
+    else value *= exact_powers_of_ten[exponent];
+    *out = negative ? -value : value;
+    return p;
+  }
+  std::string text(start, p);
+  *out = strtod(text.c_str(), nullptr);
+  return p;
+}
+
+static void parse_coords(char const* p, char const* end,
+    char const* filename, std::vector<Vector>& out) {
+  int line = 0;
+  while (p != end) {
+    ++line;
+    auto eol = static_cast<char const*>(memchr(p, '\n', std::size_t(end - p)));
+    if (!eol) eol = end;
+    while (p != eol && is_blank(*p)) ++p;
+    if (p != eol && *p != '%' && *p != '#') {
+      double x[3] = {0, 0, 0};
+      int n = 0;
+      while (p != eol) {
+        if (n == 3) break;
+        auto q = parse_number(p, eol, &x[n]);
+        if (q == p) break;
+        ++n;
+        p = q;
+        while (p != eol && (is_blank(*p) || *p == ',')) ++p;
+      }
+      if (n < 2 || p != eol) {
+        fprintf(stderr, "%s:%d: expected two or three coordinates\n",
+            filename, line);
+        abort();
+      }
+      out.push_back(Vector{x[0], x[1], x[2]});
+    }
+    p = (eol == end) ? end : eol + 1;
+  }
+}
+
+std::vector<Vector> read_coords(char const* filename) {
+  GMOD_PHASE(PHASE_READ_COORDS);
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "could not open %s for reading\n", filename);
+    abort();
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    fprintf(stderr, "could not stat %s\n", filename);
+    abort();
+  }
+  std::vector<Vector> out;
+  auto size = std::size_t(st.st_size);
+  if (size != 0) {
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "could not map %s\n", filename);
+      abort();
+    }
+    /* lines like "0.9900000 0.0012100" are about 20 bytes */
+    out.reserve(size / 20 + 1);
+    auto text = static_cast<char const*>(data);
+    parse_coords(text, text + size, filename, out);
+    munmap(data, size);
+  }
+  close(fd);
+  return out;
+}
+
+ProfileChains split_profile(std::vector<Vector> const& pts) {
+  if (pts.size() < 2) {
+    fprintf(stderr, "split_profile needs at least two points\n");
+    abort();
+  }
+  std::size_t leading = 0;
+  std::size_t trailing = 0;
+  for (std::size_t i = 1; i < pts.size(); ++i) {
+    if (pts[i].x < pts[leading].x) leading = i;
+    if (pts[i].x > pts[trailing].x) trailing = i;
+  }
+  auto const& lead = pts[leading];
+  auto const& trail = pts[trailing];
+  ProfileChains chains;
+  chains.lower.push_back(lead);
+  chains.upper.push_back(trail);
+  for (auto const& p : pts) {
+    /* closed profiles often repeat their first point at the end */
+    if ((p.x == lead.x && p.y == lead.y) ||
+        (p.x == trail.x && p.y == trail.y)) {
+      continue;
+    }
+    if (p.y < 0) chains.lower.push_back(p);
+    if (p.y > 0) chains.upper.push_back(p);
+  }
+  /* keep the file order along each chain, only turning it around
+     if it runs the wrong way */
+  if (chains.lower.size() > 2 && chains.lower[1].x > chains.lower.back().x)
+    std::reverse(chains.lower.begin() + 1, chains.lower.end());
+  if (chains.upper.size() > 2 && chains.upper[1].x < chains.upper.back().x)
+    std::reverse(chains.upper.begin() + 1, chains.upper.end());
+  chains.lower.push_back(trail);
+  chains.upper.push_back(lead);
+  return chains;
+}
+
+ObjPtr new_profile_loop(ProfileChains const& chains) {
+  assert(chains.lower.size() >= 2 && chains.upper.size() >= 2);
+  auto leading = new_point2(chains.lower.front());
+  auto trailing = new_point2(chains.lower.back());
+  std::vector<PointPtr> lower;
+  lower.reserve(chains.lower.size());
+  lower.push_back(leading);
+  for (std::size_t i = 1; i + 1 < chains.lower.size(); ++i)
+    lower.push_back(new_point2(chains.lower[i]));
+  lower.push_back(trailing);
+  std::vector<PointPtr> upper;
+  upper.reserve(chains.upper.size());
+  upper.push_back(trailing);
+  for (std::size_t i = 1; i + 1 < chains.upper.size(); ++i)
+    upper.push_back(new_point2(chains.upper[i]));
+  upper.push_back(leading);
+  auto loop = new_loop();
+  add_use(loop, FORWARD, new_spline2(lower));
+  add_use(loop, FORWARD, new_spline2(upper));
+  return loop;
+}
+
 ObjPtr new_plane() { return new_object(PLANE); }
 
 ObjPtr new_plane2(ObjPtr loop) {
@@ -619,10 +1484,10 @@ ObjPtr new_plane2(ObjPtr loop) {
   return p;
 }
 
-Vector plane_normal(ObjPtr plane, double epsilon) {
+Vector plane_normal(ObjPtr const& plane, double epsilon) {
   auto loop = face_loop(plane);
   auto pts = loop_points(loop);
-  Vector vectors[2];
+  Vector vectors[2] = {};
   size_t i;
   for (i = 1; i < pts.size(); ++i) {
     vectors[0] = pts[i]->pos - pts[0]->pos;
@@ -670,23 +1535,30 @@ void add_hole_to_face(ObjPtr face, ObjPtr loop) {
   add_use(face, REVERSE, loop);
 }
 
+ExtrudedVolume::ExtrudedVolume() : Object(VOLUME), translation{0, 0, 0} {
+  flags |= OBJECT_EXTRUDED;
+}
+
+ExtrudedVolume::~ExtrudedVolume() {}
+
+static ObjPtr new_extruded_volume(ObjPtr const& shell, Vector translation) {
+  auto v = std::allocate_shared<ExtrudedVolume>(
+      ResourceAllocator<ExtrudedVolume>(memory_resource));
+  v->translation = translation;
+  add_use(v, FORWARD, shell);
+  return v;
+}
+
 Extruded extrude_face(ObjPtr face, Vector v) {
   return extrude_face2(face, [=](Vector a){return a + v;});
 }
 
 Extruded extrude_face2(ObjPtr face, Transform tr) {
-  auto closure = get_closure(face, false, true);
-  auto start_points = filter_points(closure);
-  auto start_edges = filter_by_dim(closure, 1);
-  auto point_extrusions = extrude_points(start_points, tr);
-  auto edge_extrusions = extrude_edges(start_edges, tr, point_extrusions);
-  auto result = extrude_face3(face, edge_extrusions);
-  for (auto obj : start_points) obj->scratch = -1;
-  for (auto obj : start_edges) obj->scratch = -1;
-  return result;
+  return extrude_face_layers(face, std::vector<Transform>(1, tr))[0];
 }
 
 Extruded extrude_face3(ObjPtr face, std::vector<Extruded> const& edge_extrusions) {
+  GMOD_PHASE(PHASE_EXTRUDE);
   assert(type_dims[face->type] == 2);
   ObjPtr end;
   switch (face->type) {
@@ -703,37 +1575,236 @@ Extruded extrude_face3(ObjPtr face, std::vector<Extruded> const& edge_extrusions
   auto shell = new_shell();
   add_use(shell, REVERSE, face);
   add_use(shell, FORWARD, end);
-  for (auto use : face->used) {
+  for (auto const& use : face->used) {
     auto end_loop =
       extrude_loop4(use.obj, shell, use.dir, edge_extrusions).end;
     add_use(end, use.dir, end_loop);
   }
   auto middle = new_volume2(shell);
+  if (face->flags & OBJECT_TRANSFINITE) {
+    end->flags |= OBJECT_TRANSFINITE;
+    middle->flags |= OBJECT_TRANSFINITE;
+  }
   return Extruded{middle, end};
 }
 
 Extruded extrude_face_group(ObjPtr face_group, Transform tr) {
-  auto closure = get_closure(face_group, false, true);
-  auto start_points = filter_points(closure);
-  auto start_edges = filter_by_dim(closure, 1);
-  auto point_extrusions = extrude_points(start_points, tr);
-  auto edge_extrusions = extrude_edges(start_edges, tr, point_extrusions);
-  std::vector<Extruded> face_extrusions;
-  for (auto use : face_group->used) {
-    face_extrusions.push_back(extrude_face3(use.obj, edge_extrusions));
+  return extrude_face_group_layers(face_group, std::vector<Transform>(1, tr))[0];
+}
+
+/* the boundary topology of a set of faces, as indices into the
+   points and edges of their closure. it is computed once and
+   shared by every layer extruded from those faces, since each
+   layer's end faces have the same structure as the start faces. */
+struct LayerTopology {
+  std::vector<PointPtr> points;
+  std::vector<ObjPtr> edges;
+  std::vector<int> edge_points; /* two point indices per edge */
+  std::vector<int> face_loops; /* offsets into loop_uses, per face */
+  std::vector<int> loop_uses; /* offsets into use_edges, per loop */
+  std::vector<int> use_edges;
+  std::vector<int> use_dirs;
+};
+
+static LayerTopology get_layer_topology(ObjPtr root,
+    std::vector<ObjPtr> const& faces) {
+  LayerTopology topo;
+  auto closure = get_closure(root, false, true);
+  topo.points = filter_points(closure);
+  topo.edges = filter_by_dim(closure, 1);
+  for (std::size_t i = 0; i < topo.points.size(); ++i)
+    topo.points[i]->scratch = int(i);
+  topo.edge_points.reserve(topo.edges.size() * 2);
+  for (std::size_t i = 0; i < topo.edges.size(); ++i) {
+    auto edge = topo.edges[i];
+    topo.edge_points.push_back(edge_point(edge, 0)->scratch);
+    topo.edge_points.push_back(edge_point(edge, 1)->scratch);
+    edge->scratch = int(i);
+  }
+  topo.face_loops.push_back(0);
+  topo.loop_uses.push_back(0);
+  for (auto const& face : faces) {
+    assert(type_dims[face->type] == 2);
+    for (auto const& loop_use : face->used) {
+      for (auto const& use : loop_use.obj->used) {
+        topo.use_edges.push_back(use.obj->scratch);
+        topo.use_dirs.push_back(use.dir);
+      }
+      topo.loop_uses.push_back(int(topo.use_edges.size()));
+    }
+    topo.face_loops.push_back(int(topo.loop_uses.size()) - 1);
+  }
+  for (auto const& obj : topo.points) obj->scratch = -1;
+  for (auto const& obj : topo.edges) obj->scratch = -1;
+  return topo;
+}
+
+/* same as extrude_face3, but reading the loops from the topology
+   instead of from the scratch values of the edges. the volume is an
+   ExtrudedVolume if translation is given. */
+static Extruded extrude_topology_face(ObjPtr face, LayerTopology const& topo,
+    std::size_t f, std::vector<Extruded> const& edge_extrusions,
+    Vector const* translation) {
+  auto end = new_object(face->type);
+  auto shell = new_shell();
+  add_use(shell, REVERSE, face);
+  add_use(shell, FORWARD, end);
+  auto first_loop = at(topo.face_loops, int(f));
+  auto last_loop = at(topo.face_loops, int(f) + 1);
+  for (auto l = first_loop; l < last_loop; ++l) {
+    auto dir = face->used[std::size_t(l - first_loop)].dir;
+    auto end_loop = new_loop();
+    auto first_use = at(topo.loop_uses, l);
+    auto last_use = at(topo.loop_uses, l + 1);
+    for (auto u = first_use; u < last_use; ++u) {
+      add_use(end_loop, at(topo.use_dirs, u),
+          at(edge_extrusions, at(topo.use_edges, u)).end);
+    }
+    for (auto u = first_use; u < last_use; ++u) {
+      add_use(shell, at(topo.use_dirs, u) ^ dir,
+          at(edge_extrusions, at(topo.use_edges, u)).middle);
+    }
+    add_use(end, dir, end_loop);
+  }
+  auto middle = translation ? new_extruded_volume(shell, *translation)
+                            : new_volume2(shell);
+  if (face->flags & OBJECT_TRANSFINITE) {
+    end->flags |= OBJECT_TRANSFINITE;
+    middle->flags |= OBJECT_TRANSFINITE;
+  }
+  return Extruded{middle, end};
+}
+
+/* whether every point moved by the same vector, which is then
+   put in translation */
+static bool is_translation(std::vector<PointPtr> const& points,
+    std::vector<Extruded> const& point_extrusions, Vector* translation) {
+  if (points.empty()) return false;
+  auto t = object_cast<Point>(point_extrusions[0].end)->pos - points[0]->pos;
+  auto tolerance = 1e-12 * std::max(1.0, vector_norm(t));
+  for (std::size_t i = 1; i < points.size(); ++i) {
+    auto d = object_cast<Point>(point_extrusions[i].end)->pos -
+             points[i]->pos - t;
+    if (vector_norm(d) > tolerance) return false;
   }
-  for (auto obj : start_points) obj->scratch = -1;
-  for (auto obj : start_edges) obj->scratch = -1;
-  auto volume_group = new_group();
-  auto end_face_group = new_group();
-  for (auto ext : face_extrusions) {
-    add_to_group(volume_group, ext.middle);
-    add_to_group(end_face_group, ext.end);
+  *translation = t;
+  return true;
+}
+
+/* the number of objects extrude_point2, extrude_edge3 and
+   extrude_topology_face create, so ids can be handed out ahead */
+static int extruded_point_ids() { return 2; }
+
+static int extruded_edge_ids(ObjPtr edge) {
+  switch (edge->type) {
+    case LINE: return 3;
+    case ARC: return 4;
+    case ELLIPSE: return 5;
+    case SPLINE: {
+      auto n = 3 + int(edge->helpers.size());
+      if (is_inline_spline(*edge))
+        n += int(object_cast<Spline>(edge.get())->points.size());
+      return n;
+    }
+    default: return 1;
+  }
+}
+
+static int extruded_face_ids(ObjPtr face) {
+  return 3 + int(face->used.size());
+}
+
+/* runs out[i] = f(i) in parallel, giving item i the block of
+   counts[i] ids it would have been given by a serial loop */
+template <typename F>
+static void parallel_with_ids(std::vector<int> const& counts,
+    std::vector<Extruded>& out, F const& f) {
+  std::vector<int> offsets(counts.size() + 1, 0);
+  for (std::size_t i = 0; i < counts.size(); ++i)
+    offsets[i + 1] = offsets[i] + counts[i];
+  int first = next_id.fetch_add(offsets.back());
+  out.resize(counts.size());
+  parallel_for(counts.size(), [&](std::size_t i) {
+    reserved_id = first + offsets[i];
+    out[i] = f(i);
+    assert(reserved_id == first + offsets[i + 1]);
+    reserved_id = -1;
+  });
+}
+
+/* extrudes the faces through one layer per transform, each
+   transform mapping the previous layer onto the next one.
+   returns the face extrusions of each layer.
+   the point, edge and face stages run in parallel, with ids
+   assigned exactly as a serial run would assign them. */
+static std::vector<std::vector<Extruded>> extrude_faces_layers(ObjPtr root,
+    std::vector<ObjPtr> const& faces, std::vector<Transform> const& trs) {
+  auto topo = get_layer_topology(root, faces);
+  auto points = topo.points;
+  auto edges = topo.edges;
+  auto layer_faces = faces;
+  std::vector<std::vector<Extruded>> layers;
+  std::vector<int> point_ids(points.size(), extruded_point_ids());
+  std::vector<int> edge_ids;
+  for (auto const& edge : edges) edge_ids.push_back(extruded_edge_ids(edge));
+  std::vector<int> face_ids;
+  for (auto const& face : faces) face_ids.push_back(extruded_face_ids(face));
+  for (auto const& tr : trs) {
+    std::vector<Extruded> point_extrusions;
+    parallel_with_ids(point_ids, point_extrusions, [&](std::size_t i) {
+      return extrude_point2(points[i], tr);
+    });
+    std::vector<Extruded> edge_extrusions;
+    parallel_with_ids(edge_ids, edge_extrusions, [&](std::size_t i) {
+      return extrude_edge3(edges[i], tr,
+          at(point_extrusions, topo.edge_points[2 * i + 0]),
+          at(point_extrusions, topo.edge_points[2 * i + 1]));
+    });
+    Vector translation;
+    auto straight = is_translation(points, point_extrusions, &translation);
+    std::vector<Extruded> face_extrusions;
+    parallel_with_ids(face_ids, face_extrusions, [&](std::size_t f) {
+      return extrude_topology_face(layer_faces[f], topo, f, edge_extrusions,
+          straight ? &translation : nullptr);
+    });
+    for (std::size_t i = 0; i < points.size(); ++i)
+      points[i] = object_cast<Point>(point_extrusions[i].end);
+    for (std::size_t i = 0; i < edges.size(); ++i)
+      edges[i] = edge_extrusions[i].end;
+    for (std::size_t f = 0; f < layer_faces.size(); ++f)
+      layer_faces[f] = face_extrusions[f].end;
+    layers.push_back(face_extrusions);
   }
-  return Extruded{volume_group, end_face_group};
+  return layers;
+}
+
+std::vector<Extruded> extrude_face_layers(ObjPtr face,
+    std::vector<Transform> const& trs) {
+  GMOD_PHASE(PHASE_EXTRUDE);
+  auto layers = extrude_faces_layers(face, std::vector<ObjPtr>(1, face), trs);
+  std::vector<Extruded> out;
+  for (auto const& layer : layers) out.push_back(layer[0]);
+  return out;
+}
+
+std::vector<Extruded> extrude_face_group_layers(ObjPtr face_group,
+    std::vector<Transform> const& trs) {
+  GMOD_PHASE(PHASE_EXTRUDE);
+  auto layers = extrude_faces_layers(face_group, get_objs_used(face_group), trs);
+  std::vector<Extruded> out;
+  for (auto const& layer : layers) {
+    auto volume_group = new_group();
+    auto end_face_group = new_group();
+    for (auto const& ext : layer) {
+      add_to_group(volume_group, ext.middle);
+      add_to_group(end_face_group, ext.end);
+    }
+    out.push_back(Extruded{volume_group, end_face_group});
+  }
+  return out;
 }
 
-ObjPtr face_loop(ObjPtr face) { return face->used[0].obj; }
+ObjPtr face_loop(ObjPtr const& face) { return face->used[0].obj; }
 
 ObjPtr new_shell() { return new_object(SHELL); }
 
@@ -775,21 +1846,130 @@ ObjPtr new_volume2(ObjPtr shell) {
   return v;
 }
 
-ObjPtr volume_shell(ObjPtr v) { return v->used[0].obj; }
+ObjPtr volume_shell(ObjPtr const& v) { return v->used[0].obj; }
 
 ObjPtr new_cube(Vector origin, Vector x, Vector y, Vector z) {
   return extrude_face(new_square(origin, x, y), z).middle;
 }
 
-ObjPtr get_cube_face(ObjPtr cube, enum cube_face which) {
+ObjPtr get_cube_face(ObjPtr const& cube, enum cube_face which) {
   return cube->used[0].obj->used[which].obj;
 }
 
+static std::size_t grid_index(int i, int j, int k, int ni, int nj) {
+  return (std::size_t(k) * std::size_t(nj) + std::size_t(j)) * std::size_t(ni)
+    + std::size_t(i);
+}
+
+/* loop a, b, -c, -d, the same pattern extrude_edge3 produces */
+static ObjPtr new_grid_quad(ObjPtr a, ObjPtr b, ObjPtr c, ObjPtr d) {
+  auto loop = new_loop();
+  loop->used.reserve(4);
+  add_use(loop, FORWARD, a);
+  add_use(loop, FORWARD, b);
+  add_use(loop, REVERSE, c);
+  add_use(loop, REVERSE, d);
+  auto face = new_plane2(loop);
+  face->flags |= OBJECT_TRANSFINITE;
+  return face;
+}
+
+ObjPtr new_block_grid(Vector origin, Vector x, Vector y, Vector z,
+    int nx, int ny, int nz) {
+  assert(nx > 0 && ny > 0 && nz > 0);
+  std::vector<PointPtr> points;
+  points.reserve(std::size_t(nx + 1) * std::size_t(ny + 1) * std::size_t(nz + 1));
+  for (int k = 0; k <= nz; ++k)
+  for (int j = 0; j <= ny; ++j)
+  for (int i = 0; i <= nx; ++i) {
+    points.push_back(new_point2(
+          origin + double(i) * x + double(j) * y + double(k) * z));
+  }
+  auto point = [&](int i, int j, int k) {
+    return points[grid_index(i, j, k, nx + 1, ny + 1)];
+  };
+  /* edges along x, y and z */
+  std::vector<ObjPtr> x_edges, y_edges, z_edges;
+  x_edges.reserve(std::size_t(nx) * std::size_t(ny + 1) * std::size_t(nz + 1));
+  y_edges.reserve(std::size_t(nx + 1) * std::size_t(ny) * std::size_t(nz + 1));
+  z_edges.reserve(std::size_t(nx + 1) * std::size_t(ny + 1) * std::size_t(nz));
+  for (int k = 0; k <= nz; ++k)
+  for (int j = 0; j <= ny; ++j)
+  for (int i = 0; i < nx; ++i)
+    x_edges.push_back(new_line2(point(i, j, k), point(i + 1, j, k)));
+  for (int k = 0; k <= nz; ++k)
+  for (int j = 0; j < ny; ++j)
+  for (int i = 0; i <= nx; ++i)
+    y_edges.push_back(new_line2(point(i, j, k), point(i, j + 1, k)));
+  for (int k = 0; k < nz; ++k)
+  for (int j = 0; j <= ny; ++j)
+  for (int i = 0; i <= nx; ++i)
+    z_edges.push_back(new_line2(point(i, j, k), point(i, j, k + 1)));
+  auto x_edge = [&](int i, int j, int k) {
+    return x_edges[grid_index(i, j, k, nx, ny + 1)];
+  };
+  auto y_edge = [&](int i, int j, int k) {
+    return y_edges[grid_index(i, j, k, nx + 1, ny)];
+  };
+  auto z_edge = [&](int i, int j, int k) {
+    return z_edges[grid_index(i, j, k, nx + 1, ny + 1)];
+  };
+  /* faces normal to x, y and z, oriented along +x, -y and +z
+     just like the faces of new_cube */
+  std::vector<ObjPtr> x_faces, y_faces, z_faces;
+  x_faces.reserve(std::size_t(nx + 1) * std::size_t(ny) * std::size_t(nz));
+  y_faces.reserve(std::size_t(nx) * std::size_t(ny + 1) * std::size_t(nz));
+  z_faces.reserve(std::size_t(nx) * std::size_t(ny) * std::size_t(nz + 1));
+  for (int k = 0; k < nz; ++k)
+  for (int j = 0; j < ny; ++j)
+  for (int i = 0; i <= nx; ++i)
+    x_faces.push_back(new_grid_quad(y_edge(i, j, k), z_edge(i, j + 1, k),
+          y_edge(i, j, k + 1), z_edge(i, j, k)));
+  for (int k = 0; k < nz; ++k)
+  for (int j = 0; j <= ny; ++j)
+  for (int i = 0; i < nx; ++i)
+    y_faces.push_back(new_grid_quad(x_edge(i, j, k), z_edge(i + 1, j, k),
+          x_edge(i, j, k + 1), z_edge(i, j, k)));
+  for (int k = 0; k <= nz; ++k)
+  for (int j = 0; j < ny; ++j)
+  for (int i = 0; i < nx; ++i)
+    z_faces.push_back(new_grid_quad(x_edge(i, j, k), y_edge(i + 1, j, k),
+          x_edge(i, j + 1, k), y_edge(i, j, k)));
+  auto x_face = [&](int i, int j, int k) {
+    return x_faces[grid_index(i, j, k, nx + 1, ny)];
+  };
+  auto y_face = [&](int i, int j, int k) {
+    return y_faces[grid_index(i, j, k, nx, ny + 1)];
+  };
+  auto z_face = [&](int i, int j, int k) {
+    return z_faces[grid_index(i, j, k, nx, ny)];
+  };
+  auto group = new_group();
+  group->used.reserve(std::size_t(nx) * std::size_t(ny) * std::size_t(nz));
+  for (int k = 0; k < nz; ++k)
+  for (int j = 0; j < ny; ++j)
+  for (int i = 0; i < nx; ++i) {
+    auto shell = new_shell();
+    shell->used.reserve(6);
+    add_use(shell, REVERSE, z_face(i, j, k));     /* BOTTOM */
+    add_use(shell, FORWARD, z_face(i, j, k + 1)); /* TOP */
+    add_use(shell, FORWARD, y_face(i, j, k));     /* FRONT */
+    add_use(shell, FORWARD, x_face(i + 1, j, k)); /* RIGHT */
+    add_use(shell, REVERSE, y_face(i, j + 1, k)); /* BACK */
+    add_use(shell, REVERSE, x_face(i, j, k));     /* LEFT */
+    auto volume = new_volume2(shell);
+    volume->flags |= OBJECT_TRANSFINITE;
+    add_to_group(group, volume);
+  }
+  return group;
+}
+
 ObjPtr new_ball(Vector center, Vector normal, Vector x) {
   return new_volume2(new_sphere(center, normal, x));
 }
 
 void insert_into(ObjPtr into, ObjPtr o) {
+  GMOD_PHASE(PHASE_INSERT);
   if (is_face(o->type)) {
     assert(is_face(into->type));
     add_use(into, REVERSE, face_loop(o));
@@ -807,12 +1987,50 @@ void insert_into(ObjPtr into, ObjPtr o) {
   }
 }
 
+static std::vector<AssemblyBoundary> collect_assembly_boundaries(
+    std::vector<ObjPtr> const& assemblies, bool detailed);
+
+void insert_many(ObjPtr into, std::vector<ObjPtr> const& objs) {
+  GMOD_PHASE(PHASE_INSERT);
+  std::vector<ObjPtr> groups;
+  for (auto const& o : objs) {
+    if (is_face(o->type)) {
+      assert(is_face(into->type));
+    } else if (o->type == VOLUME) {
+      assert(into->type == VOLUME);
+    } else if (o->type == GROUP) {
+      if (o->used.empty()) {
+        fprintf(stderr, "inserted group %u is empty\n", o->id);
+        abort();
+      }
+      groups.push_back(o);
+    } else {
+      fprintf(stderr, "unexpected inserted type \"%s\"\n",
+          type_names[o->type]);
+      abort();
+    }
+  }
+  auto boundaries = collect_assembly_boundaries(groups, false);
+  into->used.reserve(into->used.size() + objs.size());
+  std::size_t next_group = 0;
+  for (auto const& o : objs) {
+    if (o->type == GROUP) {
+      auto boundary = boundaries[next_group++].boundary;
+      assert(boundary->type == get_boundary_type(into->type));
+      add_use(into, REVERSE, boundary);
+    } else {
+      add_use(into, REVERSE, o->used[0].obj);
+    }
+  }
+}
+
 ObjPtr new_group() { return new_object(GROUP); }
 
 void add_to_group(ObjPtr group, ObjPtr o) { add_use(group, FORWARD, o); }
 
 void weld_volume_face_into(ObjPtr big_volume, ObjPtr small_volume,
                            ObjPtr big_volume_face, ObjPtr small_volume_face) {
+  GMOD_PHASE(PHASE_WELD);
   insert_into(big_volume_face, small_volume_face);
   add_use(volume_shell(big_volume),
           !(get_used_dir(volume_shell(small_volume), small_volume_face)),
@@ -821,6 +2039,7 @@ void weld_volume_face_into(ObjPtr big_volume, ObjPtr small_volume,
 
 void weld_plane_with_holes_into(ObjPtr big_volume, ObjPtr small_volume,
                            ObjPtr big_volume_face, ObjPtr small_volume_face) {
+  GMOD_PHASE(PHASE_WELD);
   weld_volume_face_into(big_volume, small_volume, big_volume_face, small_volume_face);
   for (size_t i = 1; i < small_volume_face->used.size(); ++i) {
     auto hole_loop = small_volume_face->used[i].obj;
@@ -841,166 +2060,1571 @@ static int are_perpendicular(Vector a, Vector b) {
          (0.0 - fabs(dot_product(normalize_vector(a), normalize_vector(b))));
 }
 
-Vector eval(ObjPtr o, double const* param) {
-  switch (o->type) {
-    case POINT: {
-      auto p = std::dynamic_pointer_cast<Point>(o);
-      return p->pos;
-    }
-    case LINE: {
-      double u = param[0];
-      PointPtr a = edge_point(o, 0);
-      PointPtr b = edge_point(o, 1);
-      return add_vectors(scale_vector(1.0 - u, a->pos),
-                         scale_vector(u, b->pos));
+static Vector eval_line(Vector a, Vector b, double u) {
+  return add_vectors(scale_vector(1.0 - u, a), scale_vector(u, b));
+}
+
+static Vector eval_arc(Vector a, Vector c, Vector b, double u) {
+  Vector ca = subtract_vectors(a, c);
+  Vector cb = subtract_vectors(b, c);
+  Vector n = normalize_vector(cross_product(ca, cb));
+  double full_ang =
+      acos(dot_product(ca, cb) / (vector_norm(ca) * vector_norm(cb)));
+  double ang = full_ang * u;
+  return rotate_vector(n, ang, ca);
+}
+
+static Vector eval_ellipse(Vector a, Vector c, Vector m, Vector b, double u) {
+  Vector ca = subtract_vectors(a, c);
+  Vector cb = subtract_vectors(b, c);
+  Vector cm = subtract_vectors(m, c);
+  if (!are_parallel(cb, cm)) {
+    u = 1.0 - u;
+    if (!are_parallel(cb, cm)) {
+      fprintf(stderr, "gmodel only understands quarter ellipses,\n");
+      fprintf(stderr, "and this one has no endpoint on the major axis\n");
+      abort();
     }
-    case ARC: {
-      double u = param[0];
-      PointPtr a = edge_point(o, 0);
-      PointPtr c = arc_center(o);
-      PointPtr b = edge_point(o, 1);
-      Vector n = arc_normal(o);
-      Vector ca = subtract_vectors(a->pos, c->pos);
-      Vector cb = subtract_vectors(b->pos, c->pos);
-      double full_ang =
-          acos(dot_product(ca, cb) / (vector_norm(ca) * vector_norm(cb)));
-      double ang = full_ang * u;
-      return rotate_vector(n, ang, ca);
-    }
-    case ELLIPSE: {
-      double u = param[0];
-      PointPtr a = edge_point(o, 0);
-      PointPtr c = ellipse_center(o);
-      PointPtr m = ellipse_major_pt(o);
-      PointPtr b = edge_point(o, 1);
-      Vector ca = subtract_vectors(a->pos, c->pos);
-      Vector cb = subtract_vectors(b->pos, c->pos);
-      Vector cm = subtract_vectors(m->pos, c->pos);
-      if (!are_parallel(cb, cm)) {
-        PointPtr tmp = a;
-        a = b;
-        b = tmp;
-        u = 1.0 - u;
-        if (!are_parallel(cb, cm)) {
-          fprintf(stderr, "gmodel only understands quarter ellipses,\n");
-          fprintf(stderr, "and this one has no endpoint on the major axis\n");
-          abort();
-        }
-        if (!are_perpendicular(ca, cm)) {
-          fprintf(stderr, "gmodel only understands quarter ellipses,\n");
-          fprintf(stderr, "and this one has no endpoint on the minor axis\n");
-          abort();
-        }
-      }
-      double full_ang = PI / 2.0;
-      double ang = full_ang * u;
-      return add_vectors(c->pos, add_vectors(scale_vector(cos(ang), ca),
-                                             scale_vector(sin(ang), cb)));
+    if (!are_perpendicular(ca, cm)) {
+      fprintf(stderr, "gmodel only understands quarter ellipses,\n");
+      fprintf(stderr, "and this one has no endpoint on the minor axis\n");
+      abort();
     }
+  }
+  double full_ang = PI / 2.0;
+  double ang = full_ang * u;
+  return add_vectors(c, add_vectors(scale_vector(cos(ang), ca),
+                                    scale_vector(sin(ang), cb)));
+}
+
+Vector eval(ObjPtr const& o, double const* param) {
+  return eval(ObjHandle(o), param);
+}
+
+Vector eval(ObjHandle o, double const* param) {
+  switch (o->type) {
+    case POINT:
+      return PointHandle(o)->pos;
+    case LINE:
+      return eval_line(edge_point(o, 0)->pos, edge_point(o, 1)->pos,
+          param[0]);
+    case ARC:
+      return eval_arc(edge_point(o, 0)->pos, arc_center(o)->pos,
+          edge_point(o, 1)->pos, param[0]);
+    case ELLIPSE:
+      return eval_ellipse(edge_point(o, 0)->pos, ellipse_center(o)->pos,
+          ellipse_major_pt(o)->pos, edge_point(o, 1)->pos, param[0]);
     default:
       return Vector{-42, -42, -42};
   }
 }
 
-void transform_closure(ObjPtr object, Matrix linear, Vector translation) {
+void transform_closure(ObjPtr const& object, Matrix linear, Vector translation) {
+  GMOD_PHASE(PHASE_TRANSFORM);
   auto closure = get_closure(object, true, true);
-  for (auto co : closure) {
+  for (auto const& co : closure) {
     if (co->type == POINT) {
-      auto pt = std::dynamic_pointer_cast<Point>(co);
+      auto pt = object_cast<Point>(co.get());
       pt->pos = (linear * (pt->pos)) + translation;
+      ++pt->revision;
+    } else if (is_inline_spline(*co)) {
+      auto spline = object_cast<Spline>(co.get());
+      for (auto& p : spline->points) p = (linear * p) + translation;
+      ++spline->revision;
+    } else if (is_extruded_volume(*co)) {
+      auto volume = object_cast<ExtrudedVolume>(co.get());
+      volume->translation = linear * volume->translation;
+      ++volume->revision;
+    }
+  }
+}
+
+static double axis_coord(Vector v, int axis) {
+  return (axis == 0) ? v.x : ((axis == 1) ? v.y : v.z);
+}
+
+/* a kd-tree over a fixed set of positions, stored implicitly in
+   one array of indices: each range is split at its median along
+   the axis of its depth. */
+class KdTree {
+ public:
+  explicit KdTree(std::vector<Vector> const& pos_) : pos(pos_) {
+    order.resize(pos.size());
+    for (std::size_t i = 0; i < order.size(); ++i) order[i] = int(i);
+    build(0, int(order.size()), 0);
+  }
+  /* the index of the position nearest to q for which skip(j) is
+     false, or -1 if there is none */
+  template <typename Skip>
+  int nearest(Vector q, Skip const& skip) const {
+    int best = -1;
+    double best_d2 = std::numeric_limits<double>::infinity();
+    search(0, int(order.size()), 0, q, skip, best, best_d2);
+    return best;
+  }
+ private:
+  void build(int first, int last, int axis) {
+    if (last - first < 2) return;
+    int mid = (first + last) / 2;
+    std::nth_element(order.begin() + first, order.begin() + mid,
+        order.begin() + last, [&](int a, int b) {
+          return axis_coord(pos[std::size_t(a)], axis) <
+                 axis_coord(pos[std::size_t(b)], axis);
+        });
+    build(first, mid, (axis + 1) % 3);
+    build(mid + 1, last, (axis + 1) % 3);
+  }
+  template <typename Skip>
+  void search(int first, int last, int axis, Vector q, Skip const& skip,
+      int& best, double& best_d2) const {
+    if (first >= last) return;
+    int mid = (first + last) / 2;
+    int j = order[std::size_t(mid)];
+    auto d = q - pos[std::size_t(j)];
+    auto d2 = dot_product(d, d);
+    if (d2 < best_d2 && !skip(j)) {
+      best = j;
+      best_d2 = d2;
+    }
+    auto diff = axis_coord(q, axis) - axis_coord(pos[std::size_t(j)], axis);
+    auto next = (axis + 1) % 3;
+    /* the side of q first, the other only if it can be closer */
+    int near_first = first, near_last = mid;
+    int far_first = mid + 1, far_last = last;
+    if (diff >= 0) {
+      std::swap(near_first, far_first);
+      std::swap(near_last, far_last);
+    }
+    search(near_first, near_last, next, q, skip, best, best_d2);
+    if (diff * diff < best_d2)
+      search(far_first, far_last, next, q, skip, best, best_d2);
+  }
+  std::vector<Vector> const& pos;
+  std::vector<int> order;
+};
+
+SizeOptions::SizeOptions()
+    : min_size(0),
+      max_size(std::numeric_limits<double>::infinity()),
+      factor(1),
+      circle_points(12) {}
+
+/* the radius of the circle through a, b and c, or infinity if
+   they are on one line */
+static double circumradius(Vector a, Vector b, Vector c) {
+  auto twice_area = vector_norm(cross_product(b - a, c - a));
+  if (twice_area == 0) return std::numeric_limits<double>::infinity();
+  return vector_norm(b - a) * vector_norm(c - b) * vector_norm(a - c) /
+         (2 * twice_area);
+}
+
+int assign_sizes(ObjPtr const& root, SizeOptions const& options) {
+  GMOD_PHASE(PHASE_ASSIGN_SIZES);
+  auto closure = get_closure(root, true, true);
+  /* samples are the points on curves, each Point once through its
+     scratch index, plus the inline points of splines */
+  std::vector<Vector> pos;
+  std::vector<Object*> owner;
+  /* the samples along each curve, in order */
+  std::vector<int> chain_offsets(1, 0);
+  std::vector<int> chains;
+  std::vector<int> chain_types;
+  std::vector<double> chain_radii;
+  auto sample = [&](Object* o) {
+    if (o->scratch == -1) {
+      o->scratch = int(pos.size());
+      pos.push_back(object_cast<Point>(o)->pos);
+      owner.push_back(o);
     }
+    chains.push_back(o->scratch);
+  };
+  for (auto const& obj : closure) {
+    if (!is_entity(obj->type) || type_dims[obj->type] != 1) continue;
+    auto start = edge_point(obj, 0);
+    auto end = edge_point(obj, 1);
+    double radius = std::numeric_limits<double>::infinity();
+    sample(start.get());
+    if (obj->type == SPLINE && is_inline_spline(*obj)) {
+      for (auto const& p : object_cast<Spline>(obj.get())->points) {
+        chains.push_back(int(pos.size()));
+        pos.push_back(p);
+        owner.push_back(obj.get());
+      }
+    } else if (obj->type == SPLINE) {
+      for (auto const& h : obj->helpers) sample(h.get());
+    } else if (obj->type == ARC) {
+      auto center = object_cast<Point>(obj->helpers[0].get())->pos;
+      radius = std::min(vector_norm(start->pos - center),
+                        vector_norm(end->pos - center));
+    } else if (obj->type == ELLIPSE) {
+      /* a quarter ellipse has its ends on its axes, and is most
+         curved at the end of the major one, where the radius of
+         curvature is b^2 / a */
+      auto center = object_cast<Point>(obj->helpers[0].get())->pos;
+      auto a = vector_norm(start->pos - center);
+      auto b = vector_norm(end->pos - center);
+      if (a < b) std::swap(a, b);
+      radius = b * b / a;
+    }
+    sample(end.get());
+    chain_offsets.push_back(int(chains.size()));
+    chain_types.push_back(obj->type);
+    chain_radii.push_back(radius);
+  }
+  auto n = pos.size();
+  auto nchains = chain_types.size();
+  std::vector<double> lfs(n, std::numeric_limits<double>::infinity());
+  auto limit = [&](int i, double length) {
+    auto& l = lfs[std::size_t(i)];
+    l = std::min(l, length);
+  };
+  double turn = 2 * PI / options.circle_points;
+  /* neighbours along curves, in compressed rows */
+  std::vector<int> degree(n + 1, 0);
+  for (std::size_t c = 0; c < nchains; ++c) {
+    auto first = chain_offsets[c];
+    auto last = chain_offsets[c + 1];
+    for (auto k = first; k + 1 < last; ++k) {
+      auto a = chains[std::size_t(k)];
+      auto b = chains[std::size_t(k + 1)];
+      ++degree[std::size_t(a) + 1];
+      ++degree[std::size_t(b) + 1];
+      limit(a, vector_norm(pos[std::size_t(b)] - pos[std::size_t(a)]));
+      limit(b, vector_norm(pos[std::size_t(b)] - pos[std::size_t(a)]));
+    }
+    for (auto k = first; k < last; ++k) {
+      auto radius = chain_radii[c];
+      if (chain_types[c] == SPLINE && k > first && k + 1 < last) {
+        radius = circumradius(pos[std::size_t(chains[std::size_t(k - 1)])],
+            pos[std::size_t(chains[std::size_t(k)])],
+            pos[std::size_t(chains[std::size_t(k + 1)])]);
+        limit(chains[std::size_t(k - 1)], radius * turn);
+        limit(chains[std::size_t(k + 1)], radius * turn);
+      }
+      limit(chains[std::size_t(k)], radius * turn);
+    }
+  }
+  for (std::size_t i = 0; i < n; ++i) degree[i + 1] += degree[i];
+  std::vector<int> neighbours(std::size_t(degree[n]));
+  {
+    auto fill = degree;
+    for (std::size_t c = 0; c < nchains; ++c) {
+      for (auto k = chain_offsets[c]; k + 1 < chain_offsets[c + 1]; ++k) {
+        auto a = chains[std::size_t(k)];
+        auto b = chains[std::size_t(k + 1)];
+        neighbours[std::size_t(fill[std::size_t(a)]++)] = b;
+        neighbours[std::size_t(fill[std::size_t(b)]++)] = a;
+      }
+    }
+  }
+  KdTree tree(pos);
+  parallel_for(n, [&](std::size_t i) {
+    auto skip = [&](int j) {
+      if (std::size_t(j) == i) return true;
+      /* coincident points are duplicates, not features */
+      if (pos[std::size_t(j)].x == pos[i].x &&
+          pos[std::size_t(j)].y == pos[i].y &&
+          pos[std::size_t(j)].z == pos[i].z) {
+        return true;
+      }
+      for (auto k = degree[i]; k < degree[i + 1]; ++k)
+        if (neighbours[std::size_t(k)] == j) return true;
+      return false;
+    };
+    auto j = tree.nearest(pos[i], skip);
+    if (j != -1) limit(int(i), vector_norm(pos[std::size_t(j)] - pos[i]));
+  });
+  auto size_of = [&](std::size_t i) {
+    auto size = options.factor * lfs[i];
+    return std::max(options.min_size, std::min(options.max_size, size));
+  };
+  int nsized = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    auto o = owner[i];
+    auto size = size_of(i);
+    if (std::isinf(size)) continue;
+    ++nsized;
+    if (o->type == POINT) {
+      auto point = object_cast<Point>(o);
+      if (point->size == size) continue;
+      point->size = size;
+      ++point->revision;
+    } else {
+      auto spline = object_cast<Spline>(o);
+      /* the first of its points resets the size, the rest lower it */
+      if (spline->scratch == -1) {
+        spline->scratch = 0;
+        spline->size = size;
+      } else {
+        spline->size = std::min(spline->size, size);
+      }
+      ++spline->revision;
+    }
+  }
+  for (std::size_t i = 0; i < n; ++i) owner[i]->scratch = -1;
+  return nsized;
+}
+
+/* one block of memory holding every object of a copy, control
+   blocks included. objects are placed in it by allocate_shared and
+   each of them keeps the arena alive through its allocator, so the
+   block is freed when the last object of the copy is destroyed. */
+class CopyArena {
+ public:
+  explicit CopyArena(std::size_t bytes)
+      : resource(memory_resource), capacity(0), used(0) {
+    grow(bytes);
+  }
+  ~CopyArena() {
+    for (auto const& block : blocks) {
+      resource_deallocate(resource, block.first, block.second,
+          alignof(std::max_align_t));
+    }
+  }
+  CopyArena(CopyArena const&) = delete;
+  CopyArena& operator=(CopyArena const&) = delete;
+  void* allocate(std::size_t bytes, std::size_t align) {
+    used = (used + align - 1) / align * align;
+    if (used + bytes > capacity) grow(std::max(bytes + align, capacity));
+    used = (used + align - 1) / align * align;
+    void* out = blocks.back().first + used;
+    used += bytes;
+    return out;
   }
+ private:
+  /* only needed if the size estimate was short */
+  void grow(std::size_t bytes) {
+    auto block = static_cast<char*>(resource_allocate(resource, bytes,
+        alignof(std::max_align_t)));
+    blocks.push_back(std::make_pair(block, bytes));
+    capacity = bytes;
+    used = 0;
+  }
+  MemoryResource* resource;
+  std::vector<std::pair<char*, std::size_t>> blocks;
+  std::size_t capacity;
+  std::size_t used;
+};
+
+template <typename T>
+struct ArenaAllocator {
+  typedef T value_type;
+  std::shared_ptr<CopyArena> arena;
+  explicit ArenaAllocator(std::shared_ptr<CopyArena> const& a) : arena(a) {}
+  template <typename U>
+  ArenaAllocator(ArenaAllocator<U> const& other) : arena(other.arena) {}
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, std::size_t) {}
+};
+
+template <typename T, typename U>
+static bool operator==(ArenaAllocator<T> const& a, ArenaAllocator<U> const& b) {
+  return a.arena == b.arena;
 }
 
-static ObjPtr copy_object(ObjPtr object) {
+template <typename T, typename U>
+static bool operator!=(ArenaAllocator<T> const& a, ArenaAllocator<U> const& b) {
+  return a.arena != b.arena;
+}
+
+static ObjPtr copy_object(Frozen const& model, std::size_t i,
+    std::shared_ptr<CopyArena> const& arena) {
   ObjPtr out;
-  if (object->type == POINT) {
-    auto point = std::dynamic_pointer_cast<Point>(object);
-    out = new_point3(point->pos, point->size);
+  if (model.types[i] == POINT) {
+    auto p = std::size_t(model.point_index[i]);
+    auto copy = std::allocate_shared<Point>(ArenaAllocator<Point>(arena));
+    copy->pos = Vector{model.x[p], model.y[p], model.z[p]};
+    copy->size = model.sizes[p];
+    out = copy;
+  } else if (model.inline_offsets[i] != model.inline_offsets[i + 1]) {
+    auto first = std::size_t(model.inline_offsets[i]);
+    auto last = std::size_t(model.inline_offsets[i + 1]);
+    auto copy = std::allocate_shared<Spline>(ArenaAllocator<Spline>(arena));
+    copy->points.reserve(last - first);
+    for (auto j = first; j < last; ++j) {
+      copy->points.push_back(
+          Vector{model.inline_x[j], model.inline_y[j], model.inline_z[j]});
+    }
+    copy->size = model.inline_sizes[first];
+    copy->first_point_id = take_ids(int(last - first));
+    out = copy;
+  } else if (model.extrusion_index[i] != -1) {
+    auto e = std::size_t(model.extrusion_index[i]);
+    auto copy = std::allocate_shared<ExtrudedVolume>(
+        ArenaAllocator<ExtrudedVolume>(arena));
+    copy->translation = Vector{model.extrusion_x[e], model.extrusion_y[e],
+        model.extrusion_z[e]};
+    out = copy;
   } else {
-    out = new_object(object->type);
+    out = std::allocate_shared<Object>(ArenaAllocator<Object>(arena),
+        model.types[i]);
   }
   return out;
 }
 
-ObjPtr copy_closure(ObjPtr object) {
-  auto closure = get_closure(object, true, true);
-  for (size_t i = 0; i < closure.size(); ++i) closure[i]->scratch =
-    static_cast<int>(i);
-  decltype(closure) out_closure;
-  for (auto co : closure) {
-    auto oco = copy_object(co);
-    for (auto coh : co->helpers) {
-      auto idx = coh->scratch;
-      assert(idx < co->scratch);
-      oco->helpers.push_back(at(out_closure, idx));
+static ObjPtr copy_frozen(Frozen const& model) {
+  auto n = model.types.size();
+  auto arena = std::allocate_shared<CopyArena>(
+      ResourceAllocator<CopyArena>(memory_resource), n * (sizeof(Point) + 64));
+  std::vector<ObjPtr> out;
+  out.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    out.push_back(copy_object(model, i, arena));
+    out.back()->flags |= model.flags[i] & OBJECT_TRANSFINITE;
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    auto& copy = out[i];
+    auto first = std::size_t(model.use_offsets[i]);
+    auto last = std::size_t(model.use_offsets[i + 1]);
+    copy->used.reserve(last - first);
+    for (auto j = first; j < last; ++j) {
+      copy->used.push_back(
+          Use{model.use_dirs[j], out[std::size_t(model.uses[j])]});
+    }
+    first = std::size_t(model.helper_offsets[i]);
+    last = std::size_t(model.helper_offsets[i + 1]);
+    copy->helpers.reserve(last - first);
+    for (auto j = first; j < last; ++j)
+      copy->helpers.push_back(out[std::size_t(model.helpers[j])]);
+    first = std::size_t(model.embedded_offsets[i]);
+    last = std::size_t(model.embedded_offsets[i + 1]);
+    copy->embedded.reserve(last - first);
+    for (auto j = first; j < last; ++j)
+      copy->embedded.push_back(out[std::size_t(model.embedded[j])]);
+  }
+  return out.back();
+}
+
+ObjPtr copy_closure(ObjPtr const& object) {
+  GMOD_PHASE(PHASE_COPY);
+  return copy_frozen(freeze(object));
+}
+
+Periodic copy_periodic(ObjPtr const& source, Matrix linear,
+    Vector translation) {
+  auto copy = copy_closure(source);
+  transform_closure(copy, linear, translation);
+  return Periodic{source, copy, linear, translation};
+}
+
+std::vector<ObjPtr> copy_closures(ObjPtr const& object, int ncopies) {
+  GMOD_PHASE(PHASE_COPY);
+  auto model = freeze(object);
+  std::vector<ObjPtr> copies;
+  for (int i = 0; i < ncopies; ++i) copies.push_back(copy_frozen(model));
+  return copies;
+}
+
+static Frozen freeze_objects(std::vector<ObjPtr> const& objs) {
+  Frozen model;
+  auto n = objs.size();
+  for (std::size_t i = 0; i < n; ++i) objs[i]->scratch = int(i);
+  model.types.reserve(n);
+  model.ids.reserve(n);
+  model.point_index.reserve(n);
+  model.extrusion_index.reserve(n);
+  model.flags.reserve(n);
+  model.use_offsets.reserve(n + 1);
+  model.helper_offsets.reserve(n + 1);
+  model.embedded_offsets.reserve(n + 1);
+  model.use_offsets.push_back(0);
+  model.helper_offsets.push_back(0);
+  model.embedded_offsets.push_back(0);
+  model.inline_offsets.push_back(0);
+  for (auto const& obj : objs) {
+    model.types.push_back(obj->type);
+    model.ids.push_back(obj->id);
+    model.flags.push_back(obj->flags);
+    if (obj->type == POINT) {
+      auto point = object_cast<Point>(obj);
+      model.point_index.push_back(int(model.x.size()));
+      model.x.push_back(point->pos.x);
+      model.y.push_back(point->pos.y);
+      model.z.push_back(point->pos.z);
+      model.sizes.push_back(point->size);
+    } else {
+      model.point_index.push_back(-1);
     }
-    for (auto cou : co->used) {
-      auto idx = cou.obj->scratch;
-      assert(idx < co->scratch);
-      add_use(oco, cou.dir, at(out_closure, idx));
+    if (is_extruded_volume(*obj)) {
+      auto volume = object_cast<ExtrudedVolume>(obj.get());
+      model.extrusion_index.push_back(int(model.extrusion_x.size()));
+      model.extrusion_x.push_back(volume->translation.x);
+      model.extrusion_y.push_back(volume->translation.y);
+      model.extrusion_z.push_back(volume->translation.z);
+    } else {
+      model.extrusion_index.push_back(-1);
     }
-    out_closure.push_back(oco);
+    if (is_inline_spline(*obj)) {
+      auto spline = object_cast<Spline>(obj.get());
+      auto id = spline->first_point_id;
+      for (auto const& p : spline->points) {
+        model.inline_ids.push_back(id++);
+        model.inline_x.push_back(p.x);
+        model.inline_y.push_back(p.y);
+        model.inline_z.push_back(p.z);
+        model.inline_sizes.push_back(spline->size);
+      }
+    }
+    model.inline_offsets.push_back(int(model.inline_ids.size()));
+    for (auto const& use : obj->used) {
+      model.uses.push_back(use.obj->scratch);
+      model.use_dirs.push_back(static_cast<signed char>(use.dir));
+    }
+    for (auto const& h : obj->helpers) model.helpers.push_back(h->scratch);
+    for (auto const& e : obj->embedded) model.embedded.push_back(e->scratch);
+    model.use_offsets.push_back(int(model.uses.size()));
+    model.helper_offsets.push_back(int(model.helpers.size()));
+    model.embedded_offsets.push_back(int(model.embedded.size()));
   }
-  for (auto co : closure) co->scratch = -1;
-  return out_closure.back();
+  for (auto const& obj : objs) obj->scratch = -1;
+  return model;
 }
 
-ObjPtr collect_assembly_boundary(ObjPtr assembly) {
-  std::vector<Use> uses;
-  int cell_type = -1;
-  for (auto cell_use : assembly->used) {
-    auto cell = cell_use.obj;
-    if (cell_type == -1)
-      cell_type = cell->type;
-    assert(cell_type == cell->type);
-    auto boundary = cell->used[0].obj;
-    for (auto side_use : boundary->used) {
-      uses.push_back(side_use);
-    }
-  }
-  for (auto use : uses)
-    use.obj->scratch = 0;
-  for (auto use : uses)
-    ++(use.obj->scratch);
-  auto boundary = new_object(get_boundary_type(cell_type));
-  for (auto use : uses)
-    if (use.obj->scratch == 1)
-      boundary->used.push_back(use);
-  for (auto use : uses)
-    use.obj->scratch = -1;
-  return boundary;
+Frozen freeze(ObjPtr const& root) {
+  return freeze_objects(get_closure(root, true, true));
 }
 
-void unscramble_loop(ObjPtr loop) {
-  std::multimap<ObjPtr, Use> lookup;
-  for (auto use : loop->used) {
-    lookup.insert(std::make_pair(edge_point(use.obj, 0), Use{FORWARD, use.obj}));
-    lookup.insert(std::make_pair(edge_point(use.obj, 1), Use{REVERSE, use.obj}));
+/* same traversal as get_closure, so the order is the same too */
+std::vector<int> get_closure(Frozen const& model, int obj,
+    bool include_helpers, bool include_embedded) {
+  std::vector<char> seen(model.types.size(), 0);
+  std::vector<int> queue;
+  queue.reserve(model.types.size());
+  std::size_t first = 0;
+  queue.push_back(obj);
+  auto visit = [&](std::vector<int> const& offsets,
+                   std::vector<int> const& children, int current) {
+    auto end = offsets[std::size_t(current) + 1];
+    for (auto j = offsets[std::size_t(current)]; j < end; ++j) {
+      auto child = children[std::size_t(j)];
+      if (!seen[std::size_t(child)]) {
+        seen[std::size_t(child)] = 1;
+        queue.push_back(child);
+      }
+    }
+  };
+  while (first != queue.size()) {
+    auto current = queue[first++];
+    visit(model.use_offsets, model.uses, current);
+    if (include_helpers) visit(model.helper_offsets, model.helpers, current);
+    if (include_embedded) {
+      visit(model.embedded_offsets, model.embedded, current);
+    }
+  }
+  std::reverse(queue.begin(), queue.end());
+  return queue;
+}
+
+int count_of_dim(Frozen const& model, std::vector<int> const& objs, int dim) {
+  int c = 0;
+  for (auto i : objs) {
+    auto type = model.types[std::size_t(i)];
+    if (is_entity(type) && type_dims[type] == dim) ++c;
+  }
+  return c;
+}
+
+static int frozen_use(Frozen const& model, int i, int j) {
+  return model.uses[std::size_t(model.use_offsets[std::size_t(i)] + j)];
+}
+
+static int frozen_nuses(Frozen const& model, int i) {
+  return model.use_offsets[std::size_t(i) + 1] -
+         model.use_offsets[std::size_t(i)];
+}
+
+static int frozen_use_dir(Frozen const& model, int i, int j) {
+  return model.use_dirs[std::size_t(model.use_offsets[std::size_t(i)] + j)];
+}
+
+static int frozen_helper(Frozen const& model, int i, int j) {
+  return model.helpers[std::size_t(model.helper_offsets[std::size_t(i)] + j)];
+}
+
+static int frozen_nhelpers(Frozen const& model, int i) {
+  return model.helper_offsets[std::size_t(i) + 1] -
+         model.helper_offsets[std::size_t(i)];
+}
+
+static int frozen_id(Frozen const& model, int i) {
+  return model.ids[std::size_t(i)];
+}
+
+static Vector frozen_pos(Frozen const& model, int i) {
+  auto p = std::size_t(model.point_index[std::size_t(i)]);
+  return Vector{model.x[p], model.y[p], model.z[p]};
+}
+
+Vector eval(Frozen const& model, int o, double const* param) {
+  switch (model.types[std::size_t(o)]) {
+    case POINT:
+      return frozen_pos(model, o);
+    case LINE:
+      return eval_line(frozen_pos(model, frozen_use(model, o, 0)),
+          frozen_pos(model, frozen_use(model, o, 1)), param[0]);
+    case ARC:
+      return eval_arc(frozen_pos(model, frozen_use(model, o, 0)),
+          frozen_pos(model, frozen_helper(model, o, 0)),
+          frozen_pos(model, frozen_use(model, o, 1)), param[0]);
+    case ELLIPSE:
+      return eval_ellipse(frozen_pos(model, frozen_use(model, o, 0)),
+          frozen_pos(model, frozen_helper(model, o, 0)),
+          frozen_pos(model, frozen_helper(model, o, 1)),
+          frozen_pos(model, frozen_use(model, o, 1)), param[0]);
+    default:
+      return Vector{-42, -42, -42};
+  }
+}
+
+/* the object i of a Frozen model, for the format_* templates */
+class FrozenView {
+ public:
+  FrozenView(Frozen const& model, int i) : model_(&model), i_(i) {}
+  int type() const { return model_->types[std::size_t(i_)]; }
+  int id() const { return frozen_id(*model_, i_); }
+  int nuses() const { return frozen_nuses(*model_, i_); }
+  FrozenView use(int j) const {
+    return FrozenView(*model_, frozen_use(*model_, i_, j));
+  }
+  int use_dir(int j) const { return frozen_use_dir(*model_, i_, j); }
+  int nhelpers() const { return frozen_nhelpers(*model_, i_); }
+  FrozenView helper(int j) const {
+    return FrozenView(*model_, frozen_helper(*model_, i_, j));
+  }
+  int nembedded() const {
+    return model_->embedded_offsets[std::size_t(i_) + 1] -
+           model_->embedded_offsets[std::size_t(i_)];
+  }
+  FrozenView embedded(int j) const {
+    auto k = model_->embedded_offsets[std::size_t(i_)] + j;
+    return FrozenView(*model_, model_->embedded[std::size_t(k)]);
+  }
+  Vector pos() const { return frozen_pos(*model_, i_); }
+  double size() const {
+    return model_->sizes[std::size_t(model_->point_index[std::size_t(i_)])];
+  }
+  int ninline() const {
+    return model_->inline_offsets[std::size_t(i_) + 1] -
+           model_->inline_offsets[std::size_t(i_)];
+  }
+  int inline_id(int k) const { return model_->inline_ids[inline_slot(k)]; }
+  Vector inline_pos(int k) const {
+    auto j = inline_slot(k);
+    return Vector{model_->inline_x[j], model_->inline_y[j],
+        model_->inline_z[j]};
+  }
+  double inline_size(int k) const {
+    return model_->inline_sizes[inline_slot(k)];
+  }
+
+ private:
+  std::size_t inline_slot(int k) const {
+    return std::size_t(model_->inline_offsets[std::size_t(i_)] + k);
   }
-  std::vector<Use> new_uses;
-  new_uses.push_back(loop->used[0]);
-  while (new_uses.size() < loop->used.size()) {
-    auto use = new_uses.back();
-    auto point = edge_point(use.obj, 1 - use.dir);
-    for (auto it = lookup.lower_bound(point); it != lookup.upper_bound(point); ++it) {
-      if (it->second.obj != use.obj) new_uses.push_back(it->second);
+  Frozen const* model_;
+  int i_;
+};
+
+static void print_frozen_object(FILE* f, Frozen const& model, int i) {
+  format_object(Out{f, nullptr}, FrozenView(model, i));
+}
+
+void print_closure(FILE* f, Frozen const& model) {
+  GMOD_PHASE(PHASE_WRITE_GEO);
+  auto root = int(model.types.size()) - 1;
+  for (auto i : get_closure(model, root, true, true))
+    print_frozen_object(f, model, i);
+  for (auto i : get_closure(model, root, false, true))
+    format_object_physical(Out{f, nullptr}, FrozenView(model, i));
+}
+
+void write_closure_to_geo(Frozen const& model, char const* filename) {
+  FILE* f = fopen(filename, "w");
+  print_closure(f, model);
+  fclose(f);
+}
+
+static void print_frozen_object_dmg(FILE* f, Frozen const& model, int i) {
+  format_object_dmg(Out{f, nullptr}, FrozenView(model, i));
+}
+
+void print_closure_dmg(FILE* f, Frozen const& model) {
+  GMOD_PHASE(PHASE_WRITE_DMG);
+  auto closure = get_closure(model, int(model.types.size()) - 1, false, true);
+  fprintf(f, "%u %u %u %u\n", count_of_dim(model, closure, 3),
+          count_of_dim(model, closure, 2), count_of_dim(model, closure, 1),
+          count_of_dim(model, closure, 0));
+  fprintf(f, "0 0 0\n0 0 0\n");
+  for (int d = 0; d <= 3; ++d) {
+    for (auto i : closure) {
+      if (type_dims[model.types[std::size_t(i)]] == d)
+        print_frozen_object_dmg(f, model, i);
+    }
+  }
+}
+
+void write_closure_to_dmg(Frozen const& model, char const* filename) {
+  FILE* f = fopen(filename, "w");
+  print_closure_dmg(f, model);
+  fclose(f);
+}
+
+std::vector<int> renumber_dense(Frozen& model) {
+  auto old_ids = model.ids;
+  auto n = model.types.size();
+  /* id classes: the four entity dimensions, then loops, shells
+     and groups, which share the space of the dimension they
+     bound and are numbered after its entities */
+  int next[4] = {0, 0, 0, 0};
+  int ngroups = 0;
+  std::vector<char> done(n, 0);
+  auto number_entities = [&](std::vector<int> const& objs) {
+    for (auto i : objs) {
+      auto type = model.types[std::size_t(i)];
+      if (done[std::size_t(i)] || !is_entity(type)) continue;
+      done[std::size_t(i)] = 1;
+      model.ids[std::size_t(i)] = ++next[type_dims[type]];
+    }
+  };
+  auto root = int(n) - 1;
+  number_entities(get_closure(model, root, false, true));
+  number_entities(get_closure(model, root, true, true));
+  for (auto& id : model.inline_ids) id = ++next[0];
+  for (std::size_t i = 0; i < n; ++i) {
+    switch (model.types[i]) {
+      case LOOP:
+        model.ids[i] = ++next[1];
+        break;
+      case SHELL:
+        model.ids[i] = ++next[2];
+        break;
+      case GROUP:
+        model.ids[i] = ++ngroups;
+        break;
+    }
+  }
+  return old_ids;
+}
+
+GeoOptions::GeoOptions()
+    : dense_ids(false), structured_extrusions(false), transfinite(false) {}
+
+static IdMap freeze_for_export(ObjPtr const& obj, GeoOptions const& options,
+    Frozen& model) {
+  IdMap map;
+  map.objects = get_closure(obj, true, true);
+  model = freeze_objects(map.objects);
+  if (options.dense_ids) renumber_dense(model);
+  map.ids = model.ids;
+  return map;
+}
+
+/* which extruded volumes print_closure_with_options writes as Extrude
+   commands. owner[i] is the volume whose command creates object i,
+   or -1, and output[i] is the index of object i in the output list
+   of that command (0 for the end face, 1 for the volume and 2 on for
+   the sides), or -1 for the curves and points gmsh does not return. */
+struct ExtrudePlan {
+  std::vector<int> owner;
+  std::vector<int> output;
+  std::vector<char> active;
+};
+
+static bool is_omitted(ExtrudePlan const& plan, int i) {
+  auto o = plan.owner[std::size_t(i)];
+  return o != -1 && plan.active[std::size_t(o)];
+}
+
+static int extrusion_start(Frozen const& model, int volume) {
+  return frozen_use(model, frozen_use(model, volume, 0), 0);
+}
+
+template <typename F>
+static void for_each_reference(Frozen const& model, int i, F const& f) {
+  auto j = std::size_t(i);
+  for (auto k = model.use_offsets[j]; k < model.use_offsets[j + 1]; ++k)
+    f(model.uses[std::size_t(k)]);
+  for (auto k = model.helper_offsets[j]; k < model.helper_offsets[j + 1]; ++k)
+    f(model.helpers[std::size_t(k)]);
+  for (auto k = model.embedded_offsets[j]; k < model.embedded_offsets[j + 1];
+       ++k) {
+    f(model.embedded[std::size_t(k)]);
+  }
+}
+
+static ExtrudePlan plan_extrusions(Frozen const& model,
+    std::vector<int> const& closure, bool structured) {
+  auto n = model.types.size();
+  ExtrudePlan plan;
+  plan.owner.assign(n, -1);
+  plan.output.assign(n, -1);
+  plan.active.assign(n, 0);
+  if (!structured) return plan;
+  std::vector<char> in_start(n, 0);
+  for (auto v : closure) {
+    auto vi = std::size_t(v);
+    if (model.extrusion_index[vi] == -1) continue;
+    /* holes and embedded objects are not swept */
+    if (frozen_nuses(model, v) != 1) continue;
+    if (model.embedded_offsets[vi] != model.embedded_offsets[vi + 1]) continue;
+    auto shell = frozen_use(model, v, 0);
+    auto start = extrusion_start(model, v);
+    auto start_closure = get_closure(model, start, true, true);
+    for (auto j : start_closure) in_start[std::size_t(j)] = 1;
+    bool shared = false;
+    auto generated = get_closure(model, v, true, true);
+    for (auto j : generated) {
+      auto o = plan.owner[std::size_t(j)];
+      if (in_start[std::size_t(j)] || o == -1) continue;
+      /* sides shared with a neighbour, as in a face group */
+      plan.active[std::size_t(o)] = 0;
+      shared = true;
+    }
+    if (!shared) {
+      plan.active[vi] = 1;
+      for (auto j : generated)
+        if (!in_start[std::size_t(j)]) plan.owner[std::size_t(j)] = v;
+      plan.output[vi] = 1;
+      for (int k = 1; k < frozen_nuses(model, shell); ++k)
+        plan.output[std::size_t(frozen_use(model, shell, k))] = k == 1 ? 0 : k;
+    }
+    for (auto j : start_closure) in_start[std::size_t(j)] = 0;
+  }
+  /* everything written may only refer to the faces and volumes of
+     an Extrude command, and only from a Surface Loop */
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto i : closure) {
+      auto type = model.types[std::size_t(i)];
+      if (type == GROUP || is_omitted(plan, i)) continue;
+      for_each_reference(model, i, [&](int r) {
+        if (!is_omitted(plan, r)) return;
+        if (type == SHELL && plan.output[std::size_t(r)] != -1) return;
+        plan.active[std::size_t(plan.owner[std::size_t(r)])] = 0;
+        changed = true;
+      });
+    }
+  }
+  return plan;
+}
+
+static std::string extruded_name(Frozen const& model,
+    ExtrudePlan const& plan, int i) {
+  char buf[64];
+  if (is_omitted(plan, i)) {
+    snprintf(buf, sizeof(buf), "ex%d[%d]",
+        frozen_id(model, plan.owner[std::size_t(i)]),
+        plan.output[std::size_t(i)]);
+  } else {
+    snprintf(buf, sizeof(buf), "%d", frozen_id(model, i));
+  }
+  return buf;
+}
+
+static void print_extrude_command(FILE* f, Frozen const& model,
+    ExtrudePlan const& plan, int v) {
+  auto e = std::size_t(model.extrusion_index[std::size_t(v)]);
+  auto t = Vector{model.extrusion_x[e], model.extrusion_y[e],
+      model.extrusion_z[e]};
+  auto start = extrusion_start(model, v);
+  double total_size = 0;
+  int npoints = 0;
+  for (auto j : get_closure(model, start, false)) {
+    auto p = model.point_index[std::size_t(j)];
+    if (p == -1) continue;
+    total_size += model.sizes[std::size_t(p)];
+    ++npoints;
+  }
+  int nlayers = 1;
+  if (npoints && total_size > 0) {
+    nlayers = std::max(1,
+        int(std::lround(vector_norm(t) * npoints / total_size)));
+  }
+  fprintf(f, "ex%d[] = Extrude {%f,%f,%f} {\n", frozen_id(model, v),
+      t.x, t.y, t.z);
+  fprintf(f, "  Surface{%s}; Layers{%d}; Recombine;\n};\n",
+      extruded_name(model, plan, start).c_str(), nlayers);
+}
+
+/* names for the curves and points that Extrude commands make without
+   returning them, taken from the Boundary of the side surfaces they
+   do return. gmsh bounds the side swept from a curve by that curve,
+   the line swept from its last point, the swept curve and the line
+   swept from its first point, first and last in the direction the
+   start face goes along the curve, while each side made by
+   extrude_edge3 goes from the curve's first point. */
+static std::vector<std::string> print_extruded_boundaries(FILE* f,
+    Frozen const& model, std::vector<int> const& closure,
+    ExtrudePlan const& plan) {
+  std::vector<std::string> names(model.types.size());
+  auto unnamed = [&](int i) {
+    return is_omitted(plan, i) && plan.output[std::size_t(i)] == -1 &&
+           names[std::size_t(i)].empty();
+  };
+  char buf[64];
+  for (auto v : closure) {
+    if (!plan.active[std::size_t(v)]) continue;
+    auto id = frozen_id(model, v);
+    auto shell = frozen_use(model, v, 0);
+    auto start = frozen_use(model, shell, 0);
+    std::vector<int> dirs;
+    for (int l = 0; l < frozen_nuses(model, start); ++l) {
+      auto loop = frozen_use(model, start, l);
+      for (int u = 0; u < frozen_nuses(model, loop); ++u)
+        dirs.push_back(frozen_use_dir(model, loop, u));
+    }
+    for (int k = 2; k < frozen_nuses(model, shell); ++k) {
+      auto loop = frozen_use(model, frozen_use(model, shell, k), 0);
+      auto forward = dirs[std::size_t(k - 2)] == FORWARD;
+      bool declared = false;
+      for (int g = 1; g < 4; ++g) {
+        auto e = frozen_use(model, loop, g);
+        auto p = (g == 2 || forward) ? g : 4 - g;
+        auto top = g == 2 ? -1 : frozen_use(model, e, 1);
+        if (!unnamed(e) && (top == -1 || !unnamed(top))) continue;
+        if (!declared) {
+          fprintf(f, "exb%d_%d[] = Boundary{Surface{ex%d[%d]};};\n",
+              id, k, id, k);
+          declared = true;
+        }
+        if (unnamed(e)) {
+          snprintf(buf, sizeof(buf), "Abs(exb%d_%d[%d])", id, k, p);
+          names[std::size_t(e)] = buf;
+        }
+        if (top != -1 && unnamed(top)) {
+          /* the swept lines go from the start face to the end face */
+          fprintf(f, "exp%d_%d_%d[] = Boundary{Line{Abs(exb%d_%d[%d])};};\n",
+              id, k, p, id, k, p);
+          snprintf(buf, sizeof(buf), "exp%d_%d_%d[1]", id, k, p);
+          names[std::size_t(top)] = buf;
+        }
+      }
+    }
+  }
+  return names;
+}
+
+static bool is_transfinite_face(Frozen const& model, int i) {
+  auto j = std::size_t(i);
+  if (model.types[j] != PLANE && model.types[j] != RULED) return false;
+  if (model.embedded_offsets[j] != model.embedded_offsets[j + 1]) return false;
+  if (frozen_nuses(model, i) != 1) return false;
+  return frozen_nuses(model, frozen_use(model, i, 0)) == 4;
+}
+
+static bool is_transfinite_volume(Frozen const& model, int i) {
+  auto j = std::size_t(i);
+  if (model.embedded_offsets[j] != model.embedded_offsets[j + 1]) return false;
+  if (frozen_nuses(model, i) != 1) return false;
+  auto shell = frozen_use(model, i, 0);
+  if (frozen_nuses(model, shell) != 6) return false;
+  for (int k = 0; k < 6; ++k)
+    if (!is_transfinite_face(model, frozen_use(model, shell, k))) return false;
+  return true;
+}
+
+static double frozen_edge_length(Frozen const& model, int e) {
+  auto a = frozen_pos(model, frozen_use(model, e, 0));
+  auto b = frozen_pos(model, frozen_use(model, e, 1));
+  switch (model.types[std::size_t(e)]) {
+    case ARC: {
+      auto c = frozen_pos(model, frozen_helper(model, e, 0));
+      auto r = vector_norm(a - c);
+      auto cosine = dot_product(a - c, b - c) / (r * vector_norm(b - c));
+      return r * std::acos(std::max(-1.0, std::min(1.0, cosine)));
+    }
+    case SPLINE: {
+      /* along the control points */
+      double length = 0;
+      auto prev = a;
+      for (int k = 0; k < frozen_nhelpers(model, e); ++k) {
+        auto p = frozen_pos(model, frozen_helper(model, e, k));
+        length += vector_norm(p - prev);
+        prev = p;
+      }
+      auto first = model.inline_offsets[std::size_t(e)];
+      auto last = model.inline_offsets[std::size_t(e) + 1];
+      for (auto k = std::size_t(first); k < std::size_t(last); ++k) {
+        auto p = Vector{model.inline_x[k], model.inline_y[k],
+            model.inline_z[k]};
+        length += vector_norm(p - prev);
+        prev = p;
+      }
+      return length + vector_norm(b - prev);
+    }
+    default:
+      return vector_norm(b - a);
+  }
+}
+
+static int frozen_edge_nodes(Frozen const& model, int e) {
+  auto a = std::size_t(model.point_index[std::size_t(frozen_use(model, e, 0))]);
+  auto b = std::size_t(model.point_index[std::size_t(frozen_use(model, e, 1))]);
+  auto size = (model.sizes[a] + model.sizes[b]) / 2;
+  if (!(size > 0)) return 2;
+  return std::max(2, int(std::ceil(frozen_edge_length(model, e) / size)) + 1);
+}
+
+static int find_class(std::vector<int>& parent, int i) {
+  while (parent[std::size_t(i)] != i) {
+    parent[std::size_t(i)] = parent[std::size_t(parent[std::size_t(i)])];
+    i = parent[std::size_t(i)];
+  }
+  return i;
+}
+
+/* the Transfinite and Recombine lines for GeoOptions::transfinite.
+   opposite edges of each face are joined into classes with a
+   union-find, and every edge of a class gets the largest node
+   count any of them asks for. */
+static void print_transfinite(FILE* f, Frozen const& model,
+    std::vector<int> const& closure, ExtrudePlan const& plan) {
+  auto n = model.types.size();
+  auto tagged = [&](int i) {
+    return !is_omitted(plan, i) &&
+           (model.flags[std::size_t(i)] & OBJECT_TRANSFINITE);
+  };
+  std::vector<char> is_face_used(n, 0);
+  std::vector<int> volumes;
+  for (auto i : closure) {
+    if (model.types[std::size_t(i)] != VOLUME || !tagged(i)) continue;
+    if (!is_transfinite_volume(model, i)) continue;
+    volumes.push_back(i);
+    auto shell = frozen_use(model, i, 0);
+    for (int k = 0; k < 6; ++k)
+      is_face_used[std::size_t(frozen_use(model, shell, k))] = 1;
+  }
+  std::vector<int> faces;
+  for (auto i : closure) {
+    if (is_face_used[std::size_t(i)] ||
+        (tagged(i) && is_transfinite_face(model, i))) {
+      faces.push_back(i);
+    }
+  }
+  std::vector<int> parent(n);
+  for (std::size_t i = 0; i < n; ++i) parent[i] = int(i);
+  std::vector<int> edges;
+  std::vector<char> seen(n, 0);
+  for (auto face : faces) {
+    auto loop = frozen_use(model, face, 0);
+    int e[4];
+    for (int k = 0; k < 4; ++k) {
+      e[k] = frozen_use(model, loop, k);
+      if (!seen[std::size_t(e[k])]) edges.push_back(e[k]);
+      seen[std::size_t(e[k])] = 1;
+    }
+    for (int k = 0; k < 2; ++k) {
+      auto a = find_class(parent, e[k]);
+      auto b = find_class(parent, e[k + 2]);
+      parent[std::size_t(a)] = b;
     }
   }
-  loop->used = new_uses;
+  std::vector<int> nodes(n, 0);
+  for (auto e : edges) {
+    auto c = std::size_t(find_class(parent, e));
+    nodes[c] = std::max(nodes[c], frozen_edge_nodes(model, e));
+  }
+  std::unordered_map<int, std::vector<int>> members;
+  std::vector<int> classes;
+  for (auto e : edges) {
+    auto c = find_class(parent, e);
+    auto& list = members[c];
+    if (list.empty()) classes.push_back(c);
+    list.push_back(e);
+  }
+  for (auto c : classes) {
+    fprintf(f, "Transfinite Line{");
+    auto const& list = members[c];
+    for (std::size_t k = 0; k < list.size(); ++k)
+      fprintf(f, "%s%d", k ? "," : "", frozen_id(model, list[k]));
+    fprintf(f, "} = %d;\n", nodes[std::size_t(c)]);
+  }
+  for (auto face : faces) {
+    fprintf(f, "Transfinite Surface{%d};\n", frozen_id(model, face));
+    fprintf(f, "Recombine Surface{%d};\n", frozen_id(model, face));
+  }
+  for (auto v : volumes)
+    fprintf(f, "Transfinite Volume{%d};\n", frozen_id(model, v));
+}
+
+/* one Periodic line per dimension for each record of
+   GeoOptions::periodic, pairing the curves and surfaces of the copy
+   with those of the source that are both written with their ids */
+static void print_periodic(FILE* f, Frozen const& model,
+    std::vector<ObjPtr> const& objects, ExtrudePlan const& plan,
+    std::vector<Periodic> const& periodic) {
+  std::unordered_map<Object const*, int> index;
+  for (std::size_t i = 0; i < objects.size(); ++i)
+    index[objects[i].get()] = int(i);
+  auto written = [&](Object const* o) {
+    auto it = index.find(o);
+    if (it == index.end() || is_omitted(plan, it->second)) return -1;
+    return it->second;
+  };
+  for (auto const& p : periodic) {
+    auto sources = get_closure(p.source, true, true);
+    auto copies = get_closure(p.copy, true, true);
+    bool same = sources.size() == copies.size();
+    for (std::size_t i = 0; same && i < sources.size(); ++i)
+      same = sources[i]->type == copies[i]->type;
+    if (!same) {
+      fprintf(stderr, "periodic copy %u of %u no longer matches it\n",
+          p.copy->id, p.source->id);
+      abort();
+    }
+    for (int dim = 2; dim >= 1; --dim) {
+      std::vector<int> from, to;
+      for (std::size_t i = 0; i < sources.size(); ++i) {
+        if (!is_entity(sources[i]->type)) continue;
+        if (type_dims[sources[i]->type] != dim) continue;
+        auto a = written(sources[i].get());
+        auto b = written(copies[i].get());
+        if (a == -1 || b == -1) continue;
+        from.push_back(frozen_id(model, a));
+        to.push_back(frozen_id(model, b));
+      }
+      if (from.empty()) continue;
+      fprintf(f, "Periodic %s{", dim == 2 ? "Surface" : "Line");
+      for (std::size_t i = 0; i < to.size(); ++i)
+        fprintf(f, "%s%d", i ? "," : "", to[i]);
+      fprintf(f, "} = {");
+      for (std::size_t i = 0; i < from.size(); ++i)
+        fprintf(f, "%s%d", i ? "," : "", from[i]);
+      /* the 4x4 matrix by rows, at full precision so that gmsh
+         matches the nodes of rotated copies */
+      auto const& a = p.linear;
+      auto const& t = p.translation;
+      fprintf(f, "} Affine{%.17g,%.17g,%.17g,%.17g,"
+          "%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,0,0,0,1};\n",
+          a.x.x, a.y.x, a.z.x, t.x, a.x.y, a.y.y, a.z.y, t.y,
+          a.x.z, a.y.z, a.z.z, t.z);
+    }
+  }
+}
+
+/* print_closure, with the extruded volumes of the plan written as
+   Extrude commands and objects that refer to their output after all
+   the commands, then the transfinite and periodic lines if asked for */
+static void print_closure_with_options(FILE* f, Frozen const& model,
+    std::vector<ObjPtr> const& objects, GeoOptions const& options) {
+  GMOD_PHASE(PHASE_WRITE_GEO);
+  auto n = model.types.size();
+  auto root = int(n) - 1;
+  auto closure = get_closure(model, root, true, true);
+  auto plan = plan_extrusions(model, closure, options.structured_extrusions);
+  std::vector<char> late(n, 0);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto i : closure) {
+      if (late[std::size_t(i)] || is_omitted(plan, i)) continue;
+      for_each_reference(model, i, [&](int r) {
+        if (late[std::size_t(i)]) return;
+        if (is_omitted(plan, r) || late[std::size_t(r)]) {
+          late[std::size_t(i)] = 1;
+          changed = true;
+        }
+      });
+    }
+  }
+  for (auto i : closure) {
+    if (!late[std::size_t(i)] && !is_omitted(plan, i))
+      print_frozen_object(f, model, i);
+  }
+  /* each command after the one that makes its start face */
+  std::vector<char> done(n, 0);
+  for (auto v : closure) {
+    std::vector<int> chain;
+    for (auto w = v; plan.active[std::size_t(w)] && !done[std::size_t(w)];
+         w = plan.owner[std::size_t(extrusion_start(model, w))]) {
+      done[std::size_t(w)] = 1;
+      chain.push_back(w);
+      if (!is_omitted(plan, extrusion_start(model, w))) break;
+    }
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+      print_extrude_command(f, model, plan, *it);
+  }
+  for (auto i : closure) {
+    if (!late[std::size_t(i)]) continue;
+    if (model.types[std::size_t(i)] != SHELL) {
+      print_frozen_object(f, model, i);
+      continue;
+    }
+    fprintf(f, "%s(%d) = {", type_names[SHELL], frozen_id(model, i));
+    for (int j = 0; j < frozen_nuses(model, i); ++j) {
+      if (j) fprintf(f, ",");
+      if (frozen_use_dir(model, i, j) == REVERSE) fprintf(f, "-");
+      fprintf(f, "%s",
+          extruded_name(model, plan, frozen_use(model, i, j)).c_str());
+    }
+    fprintf(f, "};\n");
+  }
+  if (options.transfinite) print_transfinite(f, model, closure, plan);
+  print_periodic(f, model, objects, plan, options.periodic);
+  auto generated = print_extruded_boundaries(f, model, closure, plan);
+  for (auto i : get_closure(model, root, false, true)) {
+    auto type = model.types[std::size_t(i)];
+    if (!is_entity(type)) continue;
+    auto name = generated[std::size_t(i)];
+    if (name.empty()) name = extruded_name(model, plan, i);
+    fprintf(f, "%s(%d) = {%s};\n", physical_type_names[type],
+        frozen_id(model, i), name.c_str());
+  }
+}
+
+IdMap write_closure_to_geo2(ObjPtr const& obj, char const* filename,
+    GeoOptions const& options) {
+  Frozen model;
+  auto map = freeze_for_export(obj, options, model);
+  if (options.structured_extrusions || options.transfinite ||
+      !options.periodic.empty()) {
+    FILE* f = fopen(filename, "w");
+    print_closure_with_options(f, model, map.objects, options);
+    fclose(f);
+  } else {
+    write_closure_to_geo(model, filename);
+  }
+  return map;
+}
+
+IdMap write_closure_to_dmg2(ObjPtr const& obj, char const* filename,
+    GeoOptions const& options) {
+  Frozen model;
+  auto map = freeze_for_export(obj, options, model);
+  write_closure_to_dmg(model, filename);
+  return map;
+}
+
+/* splitmix64's finalizer, so that nearby inputs spread out */
+static std::uint64_t mix_bits(std::uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+static void hash_in(std::uint64_t& h, std::uint64_t x) {
+  h = (h ^ mix_bits(x)) * 0x100000001b3ULL;
+}
+
+static void hash_in_value(std::uint64_t& h, double x, double quantum) {
+  /* + 0.0 turns -0 into 0 */
+  double q = std::round(x / quantum) + 0.0;
+  std::uint64_t bits;
+  static_assert(sizeof(bits) == sizeof(q), "double is not 64 bits");
+  std::memcpy(&bits, &q, sizeof(bits));
+  hash_in(h, bits);
+}
+
+static void hash_in_range(std::uint64_t& h, std::vector<int> const& offsets,
+    std::vector<int> const& values, std::size_t i) {
+  auto first = offsets[i];
+  auto last = offsets[i + 1];
+  hash_in(h, std::uint64_t(last - first));
+  for (auto j = first; j < last; ++j)
+    hash_in(h, std::uint64_t(values[std::size_t(j)]));
+}
+
+std::uint64_t hash_closure(Frozen const& model, double quantum) {
+  std::uint64_t h = 0xcbf29ce484222325ULL;
+  auto n = model.types.size();
+  hash_in(h, n);
+  for (std::size_t i = 0; i < n; ++i) {
+    hash_in(h, std::uint64_t(model.types[i]));
+    hash_in_range(h, model.use_offsets, model.uses, i);
+    for (auto j = model.use_offsets[i]; j < model.use_offsets[i + 1]; ++j)
+      hash_in(h, std::uint64_t(model.use_dirs[std::size_t(j)]));
+    hash_in_range(h, model.helper_offsets, model.helpers, i);
+    hash_in_range(h, model.embedded_offsets, model.embedded, i);
+    hash_in(h, std::uint64_t(model.inline_offsets[i + 1] -
+        model.inline_offsets[i]));
+    for (auto j = model.inline_offsets[i]; j < model.inline_offsets[i + 1];
+         ++j) {
+      hash_in_value(h, model.inline_x[std::size_t(j)], quantum);
+      hash_in_value(h, model.inline_y[std::size_t(j)], quantum);
+      hash_in_value(h, model.inline_z[std::size_t(j)], quantum);
+      hash_in_value(h, model.inline_sizes[std::size_t(j)], quantum);
+    }
+    auto p = model.point_index[i];
+    if (p == -1) continue;
+    hash_in_value(h, model.x[std::size_t(p)], quantum);
+    hash_in_value(h, model.y[std::size_t(p)], quantum);
+    hash_in_value(h, model.z[std::size_t(p)], quantum);
+    hash_in_value(h, model.sizes[std::size_t(p)], quantum);
+  }
+  return h;
+}
+
+std::uint64_t hash_closure(ObjPtr const& obj, double quantum) {
+  return hash_closure(freeze(obj), quantum);
+}
+
+ClosureCache::ClosureCache() : hits(0), misses(0) {}
+
+ObjPtr get_or_build(ClosureCache& cache, std::uint64_t key,
+    std::function<ObjPtr()> const& build) {
+  auto it = cache.models.find(key);
+  if (it != cache.models.end()) {
+    ++cache.hits;
+    return copy_frozen(it->second);
+  }
+  ++cache.misses;
+  auto obj = build();
+  cache.models[key] = freeze(obj);
+  return obj;
+}
+
+std::uint64_t remember_closure(ClosureCache& cache, ObjPtr const& obj,
+    double quantum) {
+  auto model = freeze(obj);
+  auto key = hash_closure(model, quantum);
+  cache.models[key] = std::move(model);
+  return key;
+}
+
+ObjPtr recall_closure(ClosureCache& cache, std::uint64_t key) {
+  auto it = cache.models.find(key);
+  if (it == cache.models.end()) {
+    ++cache.misses;
+    return nullptr;
+  }
+  ++cache.hits;
+  return copy_frozen(it->second);
+}
+
+ObjPtr collect_assembly_boundary(ObjPtr assembly) {
+  GMOD_PHASE(PHASE_ASSEMBLY_BOUNDARY);
+  return collect_assembly_boundary2(assembly).boundary;
+}
+
+/* the boundaries of several assemblies in one combined pass.
+   sides are counted per assembly, so assemblies that share sides
+   get the same boundaries as they would one at a time. */
+static std::vector<AssemblyBoundary> collect_assembly_boundaries(
+    std::vector<ObjPtr> const& assemblies, bool detailed) {
+  std::vector<ObjPtr> cells;
+  std::vector<int> cell_assemblies;
+  std::vector<int> cell_types(assemblies.size(), -1);
+  for (std::size_t a = 0; a < assemblies.size(); ++a) {
+    for (auto const& cell_use : assemblies[a]->used) {
+      auto const& cell = cell_use.obj;
+      if (cell_types[a] == -1)
+        cell_types[a] = cell->type;
+      assert(cell_types[a] == cell->type);
+      cells.push_back(cell);
+      cell_assemblies.push_back(int(a));
+    }
+  }
+  auto ncells = cells.size();
+  std::vector<std::size_t> offsets(ncells + 1, 0);
+  for (std::size_t c = 0; c < ncells; ++c)
+    offsets[c + 1] = offsets[c] + cells[c]->used[0].obj->used.size();
+  std::vector<Use> uses(offsets[ncells]);
+  std::vector<int> use_cells(uses.size());
+  parallel_for(ncells, [&](std::size_t c) {
+    auto const& boundary = cells[c]->used[0].obj;
+    auto i = offsets[c];
+    for (auto const& side_use : boundary->used) {
+      uses[i] = side_use;
+      use_cells[i++] = int(c);
+    }
+  });
+  /* dense indices of the distinct sides of each assembly, handed
+     out through scratch in one pass, and how many cells of that
+     assembly use each one. the uses come grouped by assembly, so a
+     side holding an index from an earlier assembly gets a new one. */
+  std::vector<int> use_sides(uses.size());
+  std::vector<int> counts;
+  int current = -1;
+  int first_side = 0;
+  for (std::size_t i = 0; i < uses.size(); ++i) {
+    auto a = cell_assemblies[std::size_t(use_cells[i])];
+    if (a != current) {
+      current = a;
+      first_side = int(counts.size());
+    }
+    auto side = uses[i].obj.get();
+    if (side->scratch < first_side) {
+      side->scratch = int(counts.size());
+      counts.push_back(0);
+    }
+    use_sides[i] = side->scratch;
+    ++counts[std::size_t(side->scratch)];
+  }
+  for (auto const& use : uses) use.obj->scratch = -1;
+  auto nsides = counts.size();
+  auto count_of = [&](std::size_t i) {
+    return counts[std::size_t(use_sides[i])];
+  };
+  std::vector<AssemblyBoundary> results(assemblies.size());
+  for (std::size_t a = 0; a < assemblies.size(); ++a) {
+    if (cell_types[a] == -1) {
+      fprintf(stderr, "assembly %u has no cells, so no boundary\n",
+          assemblies[a]->id);
+      abort();
+    }
+    results[a].boundary = new_object(get_boundary_type(cell_types[a]));
+  }
+  for (std::size_t i = 0; i < uses.size(); ++i) {
+    if (count_of(i) != 1) continue;
+    auto c = std::size_t(use_cells[i]);
+    auto& result = results[std::size_t(cell_assemblies[c])];
+    result.boundary->used.push_back(uses[i]);
+    if (detailed) result.owners.push_back(cells[c]);
+  }
+  if (detailed) {
+    /* the first cell seen using each interface */
+    std::vector<int> first_cell(nsides, -1);
+    for (std::size_t i = 0; i < uses.size(); ++i) {
+      if (count_of(i) != 2) continue;
+      auto& first = first_cell[std::size_t(use_sides[i])];
+      if (first == -1) {
+        first = use_cells[i];
+        continue;
+      }
+      auto a = std::size_t(cell_assemblies[std::size_t(first)]);
+      assert(a == std::size_t(cell_assemblies[std::size_t(use_cells[i])]));
+      results[a].interfaces.push_back(uses[i].obj);
+      results[a].interface_cells.push_back(cells[std::size_t(first)]);
+      results[a].interface_cells.push_back(cells[std::size_t(use_cells[i])]);
+    }
+  }
+  return results;
+}
+
+AssemblyBoundary collect_assembly_boundary2(ObjPtr assembly, bool detailed) {
+  GMOD_PHASE(PHASE_ASSEMBLY_BOUNDARY);
+  return collect_assembly_boundaries(
+      std::vector<ObjPtr>(1, assembly), detailed)[0];
+}
+
+/* point endpoints of the edges, as dense indices and an adjacency
+   list in CSR form, built with one hash lookup per edge end */
+struct EdgeAdjacency {
+  std::vector<int> edge_points; /* two per edge */
+  std::vector<int> offsets; /* per point, into ends */
+  std::vector<int> ends; /* 2 * edge + which end */
+};
+
+static EdgeAdjacency get_edge_adjacency(std::vector<Use> const& uses) {
+  EdgeAdjacency adj;
+  std::unordered_map<Object*, int> point_ids;
+  point_ids.reserve(uses.size() * 2);
+  adj.edge_points.reserve(uses.size() * 2);
+  for (auto const& use : uses) {
+    for (int i = 0; i < 2; ++i) {
+      auto point = use.obj->used[std::size_t(i)].obj.get();
+      auto it = point_ids.insert(std::make_pair(point, int(point_ids.size())));
+      adj.edge_points.push_back(it.first->second);
+    }
+  }
+  adj.offsets.assign(point_ids.size() + 1, 0);
+  for (auto p : adj.edge_points) ++adj.offsets[std::size_t(p) + 1];
+  for (std::size_t p = 0; p < point_ids.size(); ++p)
+    adj.offsets[p + 1] += adj.offsets[p];
+  adj.ends.resize(adj.edge_points.size());
+  auto fill = adj.offsets;
+  for (std::size_t i = 0; i < adj.edge_points.size(); ++i)
+    adj.ends[std::size_t(fill[std::size_t(adj.edge_points[i])]++)] = int(i);
+  return adj;
+}
+
+std::vector<ObjPtr> unscramble_loops(ObjPtr loop,
+    std::vector<ObjPtr>* open_chains) {
+  std::vector<Use> uses(loop->used.begin(), loop->used.end());
+  auto adj = get_edge_adjacency(uses);
+  std::vector<bool> visited(uses.size(), false);
+  /* per point, how far into its adjacency list is all visited */
+  auto cursor = adj.offsets;
+  cursor.pop_back();
+  /* finds an unvisited edge end at point p */
+  auto next_end = [&](int p) {
+    auto& c = cursor[std::size_t(p)];
+    for (; c < adj.offsets[std::size_t(p) + 1]; ++c) {
+      auto end = adj.ends[std::size_t(c)];
+      if (!visited[std::size_t(end / 2)]) return end;
+    }
+    return -1;
+  };
+  std::vector<ObjPtr> loops;
+  std::size_t nopen = 0;
+  for (std::size_t first = 0; first < uses.size(); ++first) {
+    if (visited[first]) continue;
+    visited[first] = true;
+    std::vector<Use> chain(1, uses[first]);
+    auto start = adj.edge_points[2 * first + std::size_t(uses[first].dir)];
+    auto point = adj.edge_points[2 * first + std::size_t(1 - uses[first].dir)];
+    bool closed = (point == start);
+    while (!closed) {
+      auto end = next_end(point);
+      if (end == -1) break;
+      auto e = std::size_t(end / 2);
+      visited[e] = true;
+      /* leaving through end 0 walks the edge forward */
+      auto dir = end % 2;
+      chain.push_back(Use{dir, uses[e].obj});
+      point = adj.edge_points[2 * e + std::size_t(1 - dir)];
+      closed = (point == start);
+    }
+    auto out = (loops.empty() && closed) ? loop : new_loop();
+    if (!closed) {
+      /* open chain: grow it backwards from where it started */
+      std::vector<Use> back;
+      point = start;
+      for (auto end = next_end(point); end != -1; end = next_end(point)) {
+        auto e = std::size_t(end / 2);
+        visited[e] = true;
+        /* arriving through end 1 walks the edge forward */
+        auto dir = 1 - end % 2;
+        back.push_back(Use{dir, uses[e].obj});
+        point = adj.edge_points[2 * e + std::size_t(dir)];
+      }
+      chain.insert(chain.begin(), back.rbegin(), back.rend());
+      ++nopen;
+    }
+    out->used.assign(chain.begin(), chain.end());
+    ++out->revision;
+    if (closed) loops.push_back(out);
+    else if (open_chains) open_chains->push_back(out);
+  }
+  if (loops.empty()) {
+    loop->used.clear();
+    ++loop->revision;
+  }
+  if (nopen && !open_chains) {
+    fprintf(stderr, "unscramble_loops: %zu edge chains are not closed\n",
+        nopen);
+    abort();
+  }
+  return loops;
+}
+
+void unscramble_loop(ObjPtr loop) {
+  auto loops = unscramble_loops(loop);
+  if (loops.size() != 1) {
+    fprintf(stderr, "unscramble_loop: edges form %zu loops, not one\n",
+        loops.size());
+    abort();
+  }
 }
 
 void weld_half_shell_onto(ObjPtr volume, ObjPtr big_face,
     ObjPtr half_shell, int dir) {
-  auto loop = collect_assembly_boundary(half_shell);
-  unscramble_loop(loop);
-  add_use(big_face, REVERSE, loop);
+  GMOD_PHASE(PHASE_WELD);
+  auto boundary = collect_assembly_boundary(half_shell);
+  for (auto loop : unscramble_loops(boundary)) add_use(big_face, REVERSE, loop);
   auto vshell = volume_shell(volume);
-  for (auto use : half_shell->used) add_use(vshell, use.dir ^ dir, use.obj);
+  for (auto const& use : half_shell->used) add_use(vshell, use.dir ^ dir, use.obj);
 }
 
 void embed(ObjPtr into, ObjPtr embedded) {
   into->embedded.push_back(embedded);
+  ++into->revision;
 }
 
 }  // end namespace gmod
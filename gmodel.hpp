@@ -1,9 +1,17 @@
 #ifndef GMODEL_HPP
 #define GMODEL_HPP
 
+#include <cassert>
 #include <cmath>
 #include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include <functional>
 
@@ -42,6 +50,219 @@ enum {
   REVERSE = 1,
 };
 
+/* where gmodel gets memory for objects, and for the uses, helpers
+   and embedded lists that outgrow their inline storage. */
+class MemoryResource {
+ public:
+  virtual ~MemoryResource();
+  virtual void* allocate(std::size_t bytes, std::size_t alignment) = 0;
+  virtual void deallocate(void* p, std::size_t bytes,
+      std::size_t alignment) = 0;
+};
+
+/* the resource for objects created on this thread from now on, or
+   nullptr (the default) for the global heap. returns the previous
+   one. every allocation goes back to the resource it came from,
+   whichever thread frees it. the parallel stages of extrusion hand
+   the caller's resource to their worker threads, so it has to be
+   safe to call concurrently once set_num_threads allows more than
+   one thread. */
+MemoryResource* set_memory_resource(MemoryResource* resource);
+MemoryResource* get_memory_resource();
+
+/* set_memory_resource for the lifetime of a scope */
+class ScopedMemoryResource {
+ public:
+  explicit ScopedMemoryResource(MemoryResource* resource)
+      : previous_(set_memory_resource(resource)) {}
+  ~ScopedMemoryResource() { set_memory_resource(previous_); }
+  ScopedMemoryResource(ScopedMemoryResource const&) = delete;
+  ScopedMemoryResource& operator=(ScopedMemoryResource const&) = delete;
+
+ private:
+  MemoryResource* previous_;
+};
+
+/* storage for SmallVector, from the current memory resource */
+void* allocate_list_storage(std::size_t bytes);
+void deallocate_list_storage(void* p);
+
+/* the same storage as a std allocator, for std::vector members */
+template <typename T>
+struct ListAllocator {
+  typedef T value_type;
+  ListAllocator() {}
+  template <typename U>
+  ListAllocator(ListAllocator<U> const&) {}
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(allocate_list_storage(n * sizeof(T)));
+  }
+  void deallocate(T* p, std::size_t) { deallocate_list_storage(p); }
+};
+
+template <typename T, typename U>
+bool operator==(ListAllocator<T> const&, ListAllocator<U> const&) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(ListAllocator<T> const&, ListAllocator<U> const&) {
+  return false;
+}
+
+/* room for N elements, or nothing at all when N is zero */
+template <typename T, std::size_t N>
+struct InlineStorage {
+  T* inline_data() { return reinterpret_cast<T*>(&storage); }
+  T const* inline_data() const {
+    return reinterpret_cast<T const*>(&storage);
+  }
+  typename std::aligned_storage<sizeof(T) * N, alignof(T)>::type storage;
+};
+
+template <typename T>
+struct InlineStorage<T, 0> {
+  T* inline_data() { return nullptr; }
+  T const* inline_data() const { return nullptr; }
+};
+
+/* a vector that keeps its first N elements inside the object
+   and only goes to the heap when it grows past that. most
+   edges have two uses, so this saves an allocation for them
+   and keeps traversal local. with N zero it is just a pointer
+   and two 32-bit counts. */
+template <typename T, std::size_t N>
+class SmallVector : private InlineStorage<T, N> {
+ public:
+  typedef T value_type;
+  typedef T* iterator;
+  typedef T const* const_iterator;
+  SmallVector() : data_(inline_data()), size_(0), capacity_(N) {}
+  SmallVector(SmallVector const& other) : SmallVector() {
+    assign(other.begin(), other.end());
+  }
+  SmallVector(SmallVector&& other) : SmallVector() {
+    take(std::move(other));
+  }
+  SmallVector& operator=(SmallVector const& other) {
+    if (this != &other) assign(other.begin(), other.end());
+    return *this;
+  }
+  SmallVector& operator=(SmallVector&& other) {
+    if (this != &other) {
+      clear();
+      release();
+      take(std::move(other));
+    }
+    return *this;
+  }
+  ~SmallVector() {
+    clear();
+    release();
+  }
+  template <typename It>
+  void assign(It first, It last) {
+    clear();
+    reserve(std::size_t(std::distance(first, last)));
+    for (; first != last; ++first) push_back(*first);
+  }
+  void reserve(std::size_t n) {
+    if (n <= capacity_) return;
+    assert(n <= 0xffffffffu);
+    auto p = static_cast<T*>(allocate_list_storage(n * sizeof(T)));
+    for (std::size_t i = 0; i < size_; ++i) {
+      new (p + i) T(std::move(data_[i]));
+      data_[i].~T();
+    }
+    release();
+    data_ = p;
+    capacity_ = std::uint32_t(n);
+  }
+  void push_back(T const& x) {
+    if (size_ == capacity_) {
+      T copy(x);
+      grow();
+      new (data_ + size_) T(std::move(copy));
+    } else {
+      new (data_ + size_) T(x);
+    }
+    ++size_;
+  }
+  void push_back(T&& x) {
+    if (size_ == capacity_) {
+      /* x may be one of our own elements, which grow moves */
+      T moved(std::move(x));
+      grow();
+      new (data_ + size_) T(std::move(moved));
+    } else {
+      new (data_ + size_) T(std::move(x));
+    }
+    ++size_;
+  }
+  void pop_back() { data_[--size_].~T(); }
+  void clear() {
+    for (std::size_t i = 0; i < size_; ++i) data_[i].~T();
+    size_ = 0;
+  }
+  std::size_t size() const { return size_; }
+  std::size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+  bool is_inline() const { return data_ == inline_data(); }
+  T* data() { return data_; }
+  T const* data() const { return data_; }
+  T& operator[](std::size_t i) { return data_[i]; }
+  T const& operator[](std::size_t i) const { return data_[i]; }
+  T& front() { return data_[0]; }
+  T const& front() const { return data_[0]; }
+  T& back() { return data_[size_ - 1]; }
+  T const& back() const { return data_[size_ - 1]; }
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+ private:
+  using InlineStorage<T, N>::inline_data;
+  void grow() { reserve(capacity_ ? 2 * capacity_ : 1); }
+  void release() {
+    if (!is_inline()) deallocate_list_storage(data_);
+    data_ = inline_data();
+    capacity_ = N;
+  }
+  /* expects *this to be empty and inline */
+  void take(SmallVector&& other) {
+    if (other.is_inline()) {
+      for (std::size_t i = 0; i < other.size_; ++i)
+        new (data_ + i) T(std::move(other.data_[i]));
+      size_ = other.size_;
+      other.clear();
+    } else {
+      data_ = other.data_;
+      size_ = other.size_;
+      capacity_ = other.capacity_;
+      other.data_ = other.inline_data();
+      other.size_ = 0;
+      other.capacity_ = N;
+    }
+  }
+  T* data_;
+  std::uint32_t size_;
+  std::uint32_t capacity_;
+};
+
+enum {
+  /* written to a GeoStream, uses and helpers dropped */
+  OBJECT_STREAMED = 1 << 0,
+  /* its Physical line has been written to a GeoStream */
+  OBJECT_STREAMED_PHYSICAL = 1 << 1,
+  /* a Spline, with its interior points stored inline */
+  OBJECT_INLINE_SPLINE = 1 << 2,
+  /* an ExtrudedVolume */
+  OBJECT_EXTRUDED = 1 << 3,
+  /* a four sided face or a six sided volume, see mark_transfinite */
+  OBJECT_TRANSFINITE = 1 << 4,
+};
+
 struct Object;
 
 typedef std::shared_ptr<Object> ObjPtr;
@@ -54,36 +275,154 @@ struct Use {
 struct Object {
   int type;
   int id;
-  std::vector<Use> used;
-  std::vector<ObjPtr> helpers;
-  std::vector<ObjPtr> embedded;
+  SmallVector<Use, 2> used;
+  SmallVector<ObjPtr, 0> helpers;
+  SmallVector<ObjPtr, 0> embedded;
   int scratch;
+  /* OBJECT_* bits */
+  unsigned flags;
+  /* bumped whenever the object changes, see mark_changed */
+  unsigned revision;
   Object(int type);
   virtual ~Object();
 };
 
 ObjPtr new_object(int type);
 
-int get_used_dir(ObjPtr user, ObjPtr used);
-std::vector<ObjPtr> get_objs_used(ObjPtr user);
-
-void print_object(FILE* f, ObjPtr obj);
-void print_object_physical(FILE* f, ObjPtr obj);
-void print_closure(FILE* f, ObjPtr obj);
-void print_simple_object(FILE* f, ObjPtr obj);
-
-void write_closure_to_geo(ObjPtr obj, char const* filename);
+/* drops this reference to a model and returns how many objects
+   were destroyed as a result. objects are always destroyed
+   iteratively, so even very large or deeply nested models
+   (groups of groups, ...) are torn down without deep recursion. */
+int release_closure(ObjPtr& object);
+
+/* threads used by the parallel stages of face extrusion.
+   one (the default) runs them serially and zero means
+   std::thread::hardware_concurrency(). with more than one, the
+   Transform given to an extrusion is called from several threads
+   at once and has to be safe for that. */
+void set_num_threads(int n);
+int get_num_threads();
+
+/* phase timers. when gmodel is built with GMOD_PROFILE (cmake
+   option of the same name), calls to the extrusion, get_closure,
+   copy, transform, insertion, welding, assembly boundary and
+   writer entry points are counted and timed per phase. nested calls
+   of the same phase are counted once, by their outermost call.
+   without GMOD_PROFILE none of this costs anything and the totals
+   stay empty. */
+bool profiling_enabled();
+struct PhaseStats {
+  char const* name;
+  long calls;
+  double seconds;
+};
+std::vector<PhaseStats> get_phase_stats();
+void reset_phase_stats();
+void print_phase_stats(FILE* f);
+/* while on, every timed call is also recorded as a trace event.
+   write_chrome_trace writes them in the Chrome trace event format
+   (chrome://tracing, Perfetto) and forgets them. */
+void set_tracing(bool on);
+void write_chrome_trace(char const* filename);
+
+int get_used_dir(ObjPtr const& user, ObjPtr const& used);
+std::vector<ObjPtr> get_objs_used(ObjPtr const& user);
+
+void print_object(FILE* f, ObjPtr const& obj);
+void print_object_physical(FILE* f, ObjPtr const& obj);
+void print_closure(FILE* f, ObjPtr const& obj);
+void print_simple_object(FILE* f, ObjPtr const& obj);
+
+void write_closure_to_geo(ObjPtr const& obj, char const* filename);
+
+/* the .geo text of every object written through it, so that
+   writing the model again only formats what changed since.
+   an object has changed if its revision moved (add_use,
+   add_helper, embed, transform_closure and mark_changed all
+   bump it) or, for points, if its position or size differ from
+   what was written. entries of objects that drop out of the
+   model are discarded on the next write. */
+struct GeoCache {
+  struct Entry {
+    int type;
+    unsigned revision;
+    double x, y, z, size;
+    unsigned pass;
+    std::string text;
+    std::string physical;
+  };
+  std::unordered_map<int, Entry> entries;
+  unsigned pass;
+  /* how many objects the last write had to format */
+  int nformatted;
+  GeoCache();
+};
+void print_closure(FILE* f, ObjPtr const& obj, GeoCache& cache);
+void write_closure_to_geo(ObjPtr const& obj, char const* filename,
+    GeoCache& cache);
 
-void print_object_dmg(FILE* f, ObjPtr obj);
+void print_object_dmg(FILE* f, ObjPtr const& obj);
 int count_of_type(std::vector<ObjPtr> const& objs, int type);
 int count_of_dim(std::vector<ObjPtr> const& objs, int dim);
-void print_closure_dmg(FILE* f, ObjPtr obj);
-
-void write_closure_to_dmg(ObjPtr obj, char const* filename);
+void print_closure_dmg(FILE* f, ObjPtr const& obj);
+
+/* what a closure (helpers and embedded objects included) is made
+   of, gathered in one pass. bytes is an estimate of the memory held
+   by its objects: the objects themselves, their shared_ptr control
+   blocks and whatever their uses, helpers and embedded lists had to
+   allocate beyond their inline storage. */
+struct ModelStats {
+  int nobjects;
+  int count_by_type[NTYPES];
+  /* entities only, so loops, shells and groups are left out */
+  int count_by_dim[4];
+  long nuses;
+  long nhelpers;
+  long nembedded;
+  /* objects whose lists no longer fit in their inline storage */
+  int nspilled;
+  /* control points stored inside splines rather than as Points */
+  int ninline_points;
+  std::size_t bytes;
+};
+ModelStats model_stats(ObjPtr const& root);
 
-void add_use(ObjPtr by, int dir, ObjPtr of);
-void add_helper(ObjPtr to, ObjPtr h);
-std::vector<ObjPtr> get_closure(ObjPtr obj, bool include_helpers,
+/* the same for every object alive in the process, which is
+   cheap since it comes from counters kept by Object itself */
+struct LiveStats {
+  int nobjects;
+  int count_by_type[NTYPES];
+};
+LiveStats live_stats();
+
+void write_closure_to_dmg(ObjPtr const& obj, char const* filename);
+
+/* streaming .geo output, for models too big to hold in memory
+   all at once. stream_closure writes everything in the closure of
+   obj that has not been streamed yet, then drops the uses, helpers
+   and embedded objects of what it wrote. streamed objects keep
+   their id and can still be used by new objects (which will refer
+   to them by id), but can no longer be inspected or extruded.
+   close_geo_stream streams the rest of root and closes the file. */
+struct GeoStream {
+  FILE* file;
+};
+GeoStream open_geo_stream(char const* filename);
+void stream_closure(GeoStream& stream, ObjPtr const& obj);
+void close_geo_stream(GeoStream& stream, ObjPtr const& root);
+
+void add_use(ObjPtr const& by, int dir, ObjPtr const& of);
+void add_helper(ObjPtr const& to, ObjPtr const& h);
+/* call after changing the fields of an object directly, so
+   caches such as GeoCache know to format it again */
+void mark_changed(ObjPtr const& obj);
+/* tags a face bounded by one loop of four edges, or a volume
+   bounded by six such faces, for structured meshing (see
+   GeoOptions::transfinite). the faces of extrude_edge*, new_square,
+   new_cube and new_block_grid are tagged already, as are the end
+   faces and volumes extruded from tagged faces. */
+void mark_transfinite(ObjPtr const& obj);
+std::vector<ObjPtr> get_closure(ObjPtr const& obj, bool include_helpers,
     bool include_embedded = false);
 std::vector<ObjPtr> filter_by_dim(std::vector<ObjPtr> const& objs, int dim);
 
@@ -171,6 +510,106 @@ struct Point : public Object {
 
 typedef std::shared_ptr<Point> PointPtr;
 
+/* a SPLINE that keeps its interior control points inline rather
+   than as helper Points, which saves an object per point. its end
+   points are uses like any spline's, and it has no helpers. the
+   interior points get a block of ids when the spline is made, but
+   only exist as Point lines in the .geo output, written just before
+   the spline. call mark_changed after editing points directly. */
+struct Spline : public Object {
+  std::vector<Vector, ListAllocator<Vector>> points;
+  double size;
+  /* points[i] is written as Point(first_point_id + i) */
+  int first_point_id;
+  Spline();
+  ~Spline();
+};
+
+typedef std::shared_ptr<Spline> SplinePtr;
+
+inline bool is_inline_spline(Object const& o) {
+  return (o.flags & OBJECT_INLINE_SPLINE) != 0;
+}
+
+/* a VOLUME made by sweeping a face along a straight line, which the
+   face extrusions record when their transform is a translation. its
+   outer shell is {-start, end, sides...} with one side per edge use
+   of the start face, in the order of its loops. */
+struct ExtrudedVolume : public Object {
+  Vector translation;
+  ExtrudedVolume();
+  ~ExtrudedVolume();
+};
+
+typedef std::shared_ptr<ExtrudedVolume> ExtrudedVolumePtr;
+
+inline bool is_extruded_volume(Object const& o) {
+  return (o.flags & OBJECT_EXTRUDED) != 0;
+}
+
+/* checked casts that go by Object::type instead of RTTI.
+   the type is checked with assert, so release builds pay
+   nothing for them. */
+template <typename T>
+struct ObjectKind {
+  static bool matches(Object const&) { return true; }
+};
+
+template <>
+struct ObjectKind<Point> {
+  static bool matches(Object const& o) { return o.type == POINT; }
+};
+
+template <>
+struct ObjectKind<Spline> {
+  static bool matches(Object const& o) { return is_inline_spline(o); }
+};
+
+template <>
+struct ObjectKind<ExtrudedVolume> {
+  static bool matches(Object const& o) { return is_extruded_volume(o); }
+};
+
+template <typename T>
+T* object_cast(Object* o) {
+  assert(!o || ObjectKind<T>::matches(*o));
+  return static_cast<T*>(o);
+}
+
+template <typename T>
+std::shared_ptr<T> object_cast(ObjPtr const& o) {
+  assert(!o || ObjectKind<T>::matches(*o));
+  return std::static_pointer_cast<T>(o);
+}
+
+/* a non-owning, type-checked view of an object. it does no
+   reference counting, so it is cheap to pass through inner loops,
+   but something else has to keep the object alive meanwhile. */
+template <typename T>
+class Handle {
+ public:
+  Handle() : ptr_(nullptr) {}
+  explicit Handle(Object* o) : ptr_(object_cast<T>(o)) {}
+  template <typename U>
+  explicit Handle(std::shared_ptr<U> const& o)
+      : ptr_(object_cast<T>(static_cast<Object*>(o.get()))) {}
+  template <typename U>
+  Handle(Handle<U> const& o)
+      : ptr_(object_cast<T>(static_cast<Object*>(o.get()))) {}
+  T* get() const { return ptr_; }
+  T* operator->() const { return ptr_; }
+  T& operator*() const { return *ptr_; }
+  explicit operator bool() const { return ptr_ != nullptr; }
+  bool operator==(Handle const& other) const { return ptr_ == other.ptr_; }
+  bool operator!=(Handle const& other) const { return ptr_ != other.ptr_; }
+
+ private:
+  T* ptr_;
+};
+
+typedef Handle<Object> ObjHandle;
+typedef Handle<Point> PointHandle;
+
 extern double default_size;
 
 PointPtr new_point();
@@ -179,20 +618,23 @@ PointPtr new_point3(Vector v, double size);
 std::vector<PointPtr> new_points(std::vector<Vector> vs);
 std::vector<PointPtr> filter_points(std::vector<ObjPtr> const& objs);
 
-void print_point(FILE* f, PointPtr p);
+void print_point(FILE* f, PointPtr const& p);
 
 struct Extruded {
   ObjPtr middle;
   ObjPtr end;
 };
 
+/* face extrusions may call this from several threads at once,
+   see set_num_threads */
 typedef std::function<Vector(Vector)> Transform;
 
 Extruded extrude_point(PointPtr start, Vector v);
 Extruded extrude_point2(PointPtr start, Transform tr);
 std::vector<Extruded> extrude_points(std::vector<PointPtr> const& points,
     Transform tr);
-PointPtr edge_point(ObjPtr edge, int i);
+PointPtr edge_point(ObjPtr const& edge, int i);
+PointHandle edge_point(ObjHandle edge, int i);
 
 ObjPtr new_line();
 ObjPtr new_line2(PointPtr start, PointPtr end);
@@ -201,21 +643,28 @@ ObjPtr new_line4(Vector a, Vector b);
 
 ObjPtr new_arc();
 ObjPtr new_arc2(PointPtr start, PointPtr center, PointPtr end);
-PointPtr arc_center(ObjPtr arc);
-Vector arc_normal(ObjPtr arc);
-void print_arc(FILE* f, ObjPtr arc);
+PointPtr arc_center(ObjPtr const& arc);
+PointHandle arc_center(ObjHandle arc);
+Vector arc_normal(ObjPtr const& arc);
+void print_arc(FILE* f, ObjPtr const& arc);
 
 ObjPtr new_ellipse();
 ObjPtr new_ellipse2(PointPtr start, PointPtr center, PointPtr major_pt,
                     PointPtr end);
-PointPtr ellipse_center(ObjPtr e);
-PointPtr ellipse_major_pt(ObjPtr e);
-void print_ellipse(FILE* f, ObjPtr e);
+PointPtr ellipse_center(ObjPtr const& e);
+PointHandle ellipse_center(ObjHandle e);
+PointPtr ellipse_major_pt(ObjPtr const& e);
+PointHandle ellipse_major_pt(ObjHandle e);
+void print_ellipse(FILE* f, ObjPtr const& e);
 
 ObjPtr new_spline();
 ObjPtr new_spline2(std::vector<PointPtr> const& pts);
 ObjPtr new_spline3(std::vector<Vector> const& pts);
-void print_spline(FILE* f, ObjPtr e);
+/* like new_spline3, but with the interior points inline, see Spline */
+SplinePtr new_spline4(std::vector<Vector> const& pts);
+SplinePtr new_spline5(PointPtr start, std::vector<Vector> const& interior,
+    PointPtr end);
+void print_spline(FILE* f, ObjPtr const& e);
 
 Extruded extrude_edge(ObjPtr start, Vector v);
 Extruded extrude_edge2(ObjPtr start, Vector v, Extruded left, Extruded right);
@@ -224,7 +673,7 @@ std::vector<Extruded> extrude_edges(std::vector<ObjPtr> const& edges,
     Transform tr, std::vector<Extruded> const& point_extrusions);
 
 ObjPtr new_loop();
-std::vector<PointPtr> loop_points(ObjPtr loop);
+std::vector<PointPtr> loop_points(ObjPtr const& loop);
 Extruded extrude_loop(ObjPtr start, Vector v);
 Extruded extrude_loop2(ObjPtr start, Vector v, ObjPtr shell, int shell_dir);
 Extruded extrude_loop3(ObjPtr start, Transform tr, ObjPtr shell, int shell_dir);
@@ -236,9 +685,31 @@ ObjPtr new_ellipse3(Vector center, Vector major, Vector minor);
 ObjPtr new_polyline(std::vector<PointPtr> const& pts);
 ObjPtr new_polyline2(std::vector<Vector> const& vs);
 
+/* reads a text file with one point per line, given by two or three
+   numbers (z is 0 when missing) separated by blanks or commas.
+   empty lines and lines starting with '%' or '#' are skipped. the
+   file is mapped into memory and parsed in place, which makes this
+   the fast way to load large coordinate files. */
+std::vector<Vector> read_coords(char const* filename);
+
+/* a closed profile such as an airfoil, split at y=0 into the points
+   below and above. lower runs from the leading edge (the point with
+   the least x) to the trailing edge (the greatest x) and upper runs
+   back, so lower followed by upper goes around counterclockwise.
+   both include the two edge points, other points with y=0 are left
+   out. */
+struct ProfileChains {
+  std::vector<Vector> lower;
+  std::vector<Vector> upper;
+};
+ProfileChains split_profile(std::vector<Vector> const& pts);
+/* a loop of two splines through lower and upper, sharing the edge
+   points */
+ObjPtr new_profile_loop(ProfileChains const& chains);
+
 ObjPtr new_plane();
 ObjPtr new_plane2(ObjPtr loop);
-Vector plane_normal(ObjPtr plane, double epsilon = 1e-10);
+Vector plane_normal(ObjPtr const& plane, double epsilon = 1e-10);
 
 ObjPtr new_square(Vector origin, Vector x, Vector y);
 ObjPtr new_disk(Vector center, Vector normal, Vector x);
@@ -249,11 +720,22 @@ ObjPtr new_ruled();
 ObjPtr new_ruled2(ObjPtr loop);
 
 void add_hole_to_face(ObjPtr face, ObjPtr loop);
+/* face extrusion handles points, edges and faces in parallel,
+   so the transform must be safe to call from several threads.
+   the resulting ids do not depend on the number of threads. */
 Extruded extrude_face(ObjPtr face, Vector v);
 Extruded extrude_face2(ObjPtr face, Transform tr);
 Extruded extrude_face3(ObjPtr face, std::vector<Extruded> const& edge_extrusions);
 Extruded extrude_face_group(ObjPtr face_group, Transform tr);
-ObjPtr face_loop(ObjPtr face);
+/* extrude through one layer per transform, each transform mapping
+   the previous layer onto the next. result i holds the volume(s)
+   of layer i and the face(s) at its top, which are the interfaces
+   with layer i + 1. the group version returns groups. */
+std::vector<Extruded> extrude_face_layers(ObjPtr face,
+    std::vector<Transform> const& trs);
+std::vector<Extruded> extrude_face_group_layers(ObjPtr face_group,
+    std::vector<Transform> const& trs);
+ObjPtr face_loop(ObjPtr const& face);
 
 ObjPtr new_shell();
 
@@ -262,17 +744,28 @@ ObjPtr new_sphere(Vector center, Vector normal, Vector x);
 
 ObjPtr new_volume();
 ObjPtr new_volume2(ObjPtr shell);
-ObjPtr volume_shell(ObjPtr v);
+ObjPtr volume_shell(ObjPtr const& v);
 
 ObjPtr new_cube(Vector origin, Vector x, Vector y, Vector z);
 
 enum cube_face { BOTTOM, TOP, FRONT, RIGHT, BACK, LEFT };
 
-ObjPtr get_cube_face(ObjPtr cube, enum cube_face which);
+ObjPtr get_cube_face(ObjPtr const& cube, enum cube_face which);
+
+/* nx by ny by nz conformal grid of cubes, each spanning (x,y,z).
+   every shared point, edge and face is created once, and each block's
+   shell follows the new_cube face order so get_cube_face still works.
+   returns a GROUP of the volumes, ordered with x varying fastest. */
+ObjPtr new_block_grid(Vector origin, Vector x, Vector y, Vector z,
+    int nx, int ny, int nz);
 
 ObjPtr new_ball(Vector center, Vector normal, Vector x);
 
 void insert_into(ObjPtr into, ObjPtr f);
+/* insert_into for many objects at once. the boundaries of any
+   groups are collected together in one pass, each as if it had
+   been inserted alone. empty groups have no boundary and abort. */
+void insert_many(ObjPtr into, std::vector<ObjPtr> const& objs);
 
 ObjPtr new_group();
 void add_to_group(ObjPtr group, ObjPtr o);
@@ -282,16 +775,191 @@ void weld_volume_face_into(ObjPtr big_volume, ObjPtr small_volume,
 void weld_plane_with_holes_into(ObjPtr big_volume, ObjPtr small_volume,
                            ObjPtr big_volume_face, ObjPtr small_volume_face);
 
-Vector eval(ObjPtr o, double const* param);
+Vector eval(ObjPtr const& o, double const* param);
+Vector eval(ObjHandle o, double const* param);
 
-void transform_closure(ObjPtr object, Matrix linear, Vector translation);
+void transform_closure(ObjPtr const& object, Matrix linear, Vector translation);
 
-ObjPtr copy_closure(ObjPtr object);
+struct SizeOptions {
+  double min_size;
+  double max_size;
+  /* sizes are this times the local feature size */
+  double factor;
+  /* curves get at least this many elements per full turn */
+  double circle_points;
+  /* no bounds, a factor of 1 and 12 points per turn */
+  SizeOptions();
+};
+/* sets the size of every point on a curve of the closure from its
+   local feature size: the smallest of the distance to the nearest
+   point it shares no edge with, the lengths of the edges it bounds,
+   and the radius of curvature of the curves through it over
+   circle_points. that length is scaled by factor and clamped to
+   [min_size, max_size]. nearest points come from a kd-tree, so this
+   takes O(n log n) time. points that are only arc centers or axes
+   are left alone, and inline splines take the least size of their
+   points. returns the number of points given a size. */
+int assign_sizes(ObjPtr const& root, SizeOptions const& options);
+
+/* copies everything in the closure, including embedded and
+   helper objects. all objects of one copy share one allocation,
+   which is released once none of them is referenced anymore. */
+ObjPtr copy_closure(ObjPtr const& object);
+/* ncopies copies, traversing the original only once */
+std::vector<ObjPtr> copy_closures(ObjPtr const& object, int ncopies);
+
+/* a copy whose entities are images of the source's entities under
+   x -> linear x + translation, pairing them by their place in the
+   closures of source and copy, so neither may change shape after */
+struct Periodic {
+  ObjPtr source;
+  ObjPtr copy;
+  Matrix linear;
+  Vector translation;
+};
+/* copy_closure then transform_closure, remembering both */
+Periodic copy_periodic(ObjPtr const& source, Matrix linear,
+    Vector translation);
+
+/* an immutable snapshot of a closure (helpers and embedded objects
+   included) in compressed sparse row form. objects are numbered
+   0..n-1 in get_closure order, so the root is n-1. the coordinates
+   and sizes of the points are stored as separate arrays. */
+struct Frozen {
+  std::vector<int> types;
+  std::vector<int> ids;
+  /* uses of object i are uses[use_offsets[i]..use_offsets[i+1]) */
+  std::vector<int> use_offsets;
+  std::vector<int> uses;
+  std::vector<signed char> use_dirs;
+  std::vector<int> helper_offsets;
+  std::vector<int> helpers;
+  std::vector<int> embedded_offsets;
+  std::vector<int> embedded;
+  /* index into x, y, z and sizes, or -1 for non-points */
+  std::vector<int> point_index;
+  std::vector<double> x, y, z;
+  std::vector<double> sizes;
+  /* interior points of inline splines, those of object i being
+     [inline_offsets[i]..inline_offsets[i+1]) */
+  std::vector<int> inline_offsets;
+  std::vector<int> inline_ids;
+  std::vector<double> inline_x, inline_y, inline_z;
+  std::vector<double> inline_sizes;
+  /* index into the extrusion arrays for extruded volumes, else -1 */
+  std::vector<int> extrusion_index;
+  std::vector<double> extrusion_x, extrusion_y, extrusion_z;
+  std::vector<unsigned> flags;
+};
+
+Frozen freeze(ObjPtr const& root);
+std::vector<int> get_closure(Frozen const& model, int obj,
+    bool include_helpers, bool include_embedded = false);
+int count_of_dim(Frozen const& model, std::vector<int> const& objs, int dim);
+Vector eval(Frozen const& model, int obj, double const* param);
+/* same output as the ObjPtr versions on the original root */
+void print_closure(FILE* f, Frozen const& model);
+void write_closure_to_geo(Frozen const& model, char const* filename);
+void print_closure_dmg(FILE* f, Frozen const& model);
+void write_closure_to_dmg(Frozen const& model, char const* filename);
+
+/* gives the points, edges, faces and volumes of the model the ids
+   1..n of their dimension, in closure order. helper points are
+   numbered after the other points, and loops and shells after the
+   edges and faces, so the .dmg side (which skips helpers) is dense
+   too. returns the old ids, indexed like model.ids */
+std::vector<int> renumber_dense(Frozen& model);
+
+struct GeoOptions {
+  /* write ids from renumber_dense instead of the global ones */
+  bool dense_ids;
+  /* write each extruded volume whose generated objects are only
+     used through its start face, end face or sides as a gmsh
+     Extrude command with Layers and Recombine, so that it is meshed
+     with swept prisms or hexes. the number of layers is the length
+     of the translation over the mean size of the start face's
+     points. the volume, end face and sides keep their Physical ids,
+     and the curves and points gmsh creates with them get theirs
+     through the Boundary of the sides, so the .dmg still matches. */
+  bool structured_extrusions;
+  /* write Transfinite and Recombine lines for the tagged faces and
+     volumes that still have four edges and six faces. each edge
+     gets enough nodes for the mean size of its end points, and
+     opposite edges of these faces share the largest count. */
+  bool transfinite;
+  /* written as Periodic Line and Periodic Surface lines with an
+     Affine transform, so that gmsh meshes each copied curve and
+     surface of these that is in the model as an image of its source */
+  std::vector<Periodic> periodic;
+  GeoOptions();
+};
+
+/* the id each object of the closure was written with */
+struct IdMap {
+  std::vector<ObjPtr> objects;
+  std::vector<int> ids;
+};
+
+/* for the same model and options these agree on every id */
+IdMap write_closure_to_geo2(ObjPtr const& obj, char const* filename,
+    GeoOptions const& options);
+IdMap write_closure_to_dmg2(ObjPtr const& obj, char const* filename,
+    GeoOptions const& options);
+
+/* a hash of the shape of a closure: types, uses and their
+   directions, helpers, embedded objects, and point positions and
+   sizes rounded to multiples of quantum. ids play no part, so two
+   closures built the same way hash the same wherever they sit in
+   the id sequence. */
+std::uint64_t hash_closure(Frozen const& model, double quantum = 1e-10);
+std::uint64_t hash_closure(ObjPtr const& obj, double quantum = 1e-10);
+
+/* snapshots of previously built closures, by key */
+struct ClosureCache {
+  std::unordered_map<std::uint64_t, Frozen> models;
+  int hits;
+  int misses;
+  ClosureCache();
+};
+/* a copy of the closure stored under key if there is one, otherwise
+   the result of build, which is stored under key for next time.
+   key is typically a hash of whatever parameters build depends on */
+ObjPtr get_or_build(ClosureCache& cache, std::uint64_t key,
+    std::function<ObjPtr()> const& build);
+/* stores obj under its hash_closure, which is returned */
+std::uint64_t remember_closure(ClosureCache& cache, ObjPtr const& obj,
+    double quantum = 1e-10);
+/* a copy of what is stored under key, or nullptr */
+ObjPtr recall_closure(ClosureCache& cache, std::uint64_t key);
 
 ObjPtr collect_assembly_boundary(ObjPtr assembly);
 
-void unscramble_loop(ObjPtr loop);
+struct AssemblyBoundary {
+  /* LOOP or SHELL of the sides used by only one cell */
+  ObjPtr boundary;
+  /* the rest is only filled in when asked for */
+  /* the cell using each side of the boundary */
+  std::vector<ObjPtr> owners;
+  /* the sides used by exactly two cells */
+  std::vector<ObjPtr> interfaces;
+  /* the two cells of each interface, one after the other */
+  std::vector<ObjPtr> interface_cells;
+};
 
+AssemblyBoundary collect_assembly_boundary2(ObjPtr assembly,
+    bool detailed = false);
+
+/* orders the edges of a scrambled loop into one closed loop */
+void unscramble_loop(ObjPtr loop);
+/* splits the edges of a scrambled loop into all the closed loops
+   they form, in linear time. the first one is stored back into
+   the given loop and the rest are new loops. open chains are put
+   in open_chains if given, otherwise they are an error. */
+std::vector<ObjPtr> unscramble_loops(ObjPtr loop,
+    std::vector<ObjPtr>* open_chains = nullptr);
+
+/* the half shell may have several boundary loops,
+   each becomes a hole in big_face */
 void weld_half_shell_onto(ObjPtr volume, ObjPtr big_face,
     ObjPtr half_shell, int dir);
 
@@ -0,0 +1,56 @@
+#include <gmodel.hpp>
+#include <cassert>
+
+/* the boundary of a 3x3x3 block grid has 54 faces and
+   its interior has 54 interfaces between neighbouring blocks */
+
+int main()
+{
+  auto grid = gmod::new_block_grid(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1},
+      3, 3, 3);
+  auto result = gmod::collect_assembly_boundary2(grid, true);
+  assert(result.boundary->type == gmod::SHELL);
+  assert(result.boundary->used.size() == 54);
+  assert(result.owners.size() == 54);
+  for (std::size_t i = 0; i < result.owners.size(); ++i) {
+    auto shell = gmod::volume_shell(result.owners[i]);
+    auto face = result.boundary->used[i].obj;
+    assert(gmod::get_used_dir(shell, face) == result.boundary->used[i].dir);
+  }
+  assert(result.interfaces.size() == 54);
+  assert(result.interface_cells.size() == 108);
+  for (std::size_t i = 0; i < result.interfaces.size(); ++i) {
+    auto face = result.interfaces[i];
+    auto a = gmod::volume_shell(result.interface_cells[2 * i + 0]);
+    auto b = gmod::volume_shell(result.interface_cells[2 * i + 1]);
+    assert(gmod::get_used_dir(a, face) != gmod::get_used_dir(b, face));
+  }
+  auto plain = gmod::collect_assembly_boundary(grid);
+  assert(plain->used.size() == 54);
+  assert(plain->used[0].obj == result.boundary->used[0].obj);
+  /* two touching groups keep the face between them, as they
+     would when inserted one at a time */
+  auto pair = gmod::new_block_grid(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1},
+      2, 1, 1);
+  auto left = gmod::new_group();
+  auto right = gmod::new_group();
+  gmod::add_to_group(left, pair->used[0].obj);
+  gmod::add_to_group(right, pair->used[1].obj);
+  auto outer = gmod::new_cube(
+      gmod::Vector{-1,-1,-1},
+      gmod::Vector{4,0,0},
+      gmod::Vector{0,3,0},
+      gmod::Vector{0,0,3});
+  gmod::insert_many(outer, std::vector<gmod::ObjPtr>{left, right, left});
+  assert(outer->used.size() == 4);
+  for (std::size_t i = 1; i < 4; ++i)
+    assert(outer->used[i].obj->used.size() == 6);
+}
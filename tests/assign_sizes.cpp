@@ -0,0 +1,90 @@
+#include <gmodel.hpp>
+#include <cassert>
+#include <cstdlib>
+#include <limits>
+
+static std::vector<gmod::PointPtr> points_of(gmod::ObjPtr const& root) {
+  std::vector<gmod::PointPtr> out;
+  for (auto const& o : gmod::get_closure(root, true, true))
+    if (o->type == gmod::POINT)
+      out.push_back(gmod::object_cast<gmod::Point>(o));
+  return out;
+}
+
+int main()
+{
+  gmod::SizeOptions options;
+  /* cube corners are one edge length from their neighbours and a
+     face diagonal from the rest */
+  auto cube = gmod::new_cube(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1});
+  assert(gmod::assign_sizes(cube, options) == 8);
+  for (auto const& p : points_of(cube)) assert(p->size == 1);
+  options.factor = 0.5;
+  options.max_size = 0.4;
+  gmod::assign_sizes(cube, options);
+  for (auto const& p : points_of(cube)) assert(p->size == 0.4);
+  /* a small ball inside is sized by its curvature, which leaves its
+     center alone */
+  gmod::insert_into(cube, gmod::new_ball(
+      gmod::Vector{.5,.5,.5},
+      gmod::Vector{0,0,1},
+      gmod::Vector{.05,0,0}));
+  options = gmod::SizeOptions();
+  gmod::assign_sizes(cube, options);
+  for (auto const& p : points_of(cube)) {
+    auto r = gmod::vector_norm(p->pos - gmod::Vector{.5,.5,.5});
+    if (r == 0) assert(p->size == gmod::default_size);
+    else if (r < .1) assert(std::abs(p->size - 2 * gmod::PI * .05 / 12) < 1e-9);
+    else assert(p->size > .5 && p->size <= 1);
+  }
+  /* a flat quarter ellipse is sized by its sharpest bend, of
+     radius b^2 / a */
+  auto ellipse = gmod::new_ellipse2(
+      gmod::new_point2(gmod::Vector{1,0,0}),
+      gmod::new_point2(gmod::Vector{0,0,0}),
+      gmod::new_point2(gmod::Vector{2,0,0}),
+      gmod::new_point2(gmod::Vector{0,.25,0}));
+  assert(gmod::assign_sizes(ellipse, options) == 2);
+  for (int i = 0; i < 2; ++i) {
+    assert(std::abs(gmod::edge_point(ellipse, i)->size -
+          2 * gmod::PI * .0625 / 12) < 1e-12);
+  }
+  /* random segments, checked against brute force */
+  srand(42);
+  auto group = gmod::new_group();
+  std::vector<gmod::PointPtr> pts;
+  for (int i = 0; i < 1000; ++i) {
+    auto x = rand() / double(RAND_MAX);
+    auto y = rand() / double(RAND_MAX);
+    auto z = rand() / double(RAND_MAX);
+    auto a = gmod::Vector{x, y, z};
+    auto line = gmod::new_line4(a, a + 0.05 * gmod::Vector{1,1,1});
+    gmod::add_to_group(group, line);
+    pts.push_back(gmod::edge_point(line, 0));
+    pts.push_back(gmod::edge_point(line, 1));
+  }
+  assert(gmod::assign_sizes(group, options) == 2000);
+  for (std::size_t i = 0; i < pts.size(); ++i) {
+    double expected = gmod::vector_norm(pts[i ^ 1]->pos - pts[i]->pos);
+    for (std::size_t j = 0; j < pts.size(); ++j) {
+      if (j == i || j == (i ^ 1)) continue;
+      expected = std::min(expected,
+          gmod::vector_norm(pts[j]->pos - pts[i]->pos));
+    }
+    assert(pts[i]->size == expected);
+  }
+  /* inline splines take the least size of their points, here the
+     distance between neighbours, which is below 2 pi / 12 */
+  std::vector<gmod::Vector> arc;
+  for (int i = 0; i <= 8; ++i) {
+    arc.push_back(gmod::Vector{std::cos(i * gmod::PI / 8),
+        std::sin(i * gmod::PI / 8), 0});
+  }
+  auto spline = gmod::new_spline4(arc);
+  assert(gmod::assign_sizes(spline, options) == 9);
+  assert(std::abs(spline->size - 2 * std::sin(gmod::PI / 16)) < 1e-12);
+}
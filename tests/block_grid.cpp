@@ -0,0 +1,13 @@
+#include <gmodel.hpp>
+#include <minidiff.hpp>
+
+int main()
+{
+  auto grid = gmod::new_block_grid(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1},
+      2, 1, 1);
+  prevent_regression(grid, "block_grid");
+}
@@ -0,0 +1,58 @@
+#include <gmodel.hpp>
+#include <cassert>
+
+/* identical closures hash the same no matter their ids, and a cache
+   keyed on the hash hands back copies instead of rebuilding */
+
+static gmod::ObjPtr fastener(double r) {
+  auto c = gmod::new_cube(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1});
+  gmod::insert_into(c, gmod::new_ball(
+      gmod::Vector{.5,.5,.5},
+      gmod::Vector{0,0,1},
+      gmod::Vector{r,0,0}));
+  return c;
+}
+
+int main()
+{
+  auto a = fastener(.25);
+  for (int i = 0; i < 100; ++i) gmod::new_point();
+  auto b = fastener(.25);
+  assert(gmod::hash_closure(a) == gmod::hash_closure(b));
+  assert(gmod::hash_closure(a) != gmod::hash_closure(fastener(.3)));
+  /* differences below the quantum are ignored */
+  auto p = gmod::edge_point(gmod::face_loop(
+      gmod::get_cube_face(b, gmod::TOP))->used[0].obj, 0);
+  p->pos.x += 1e-13;
+  assert(gmod::hash_closure(a) == gmod::hash_closure(b));
+  p->pos.x += 1e-3;
+  assert(gmod::hash_closure(a) != gmod::hash_closure(b));
+  auto line = gmod::new_line4(gmod::Vector{0,0,0}, gmod::Vector{1,0,0});
+  auto loop = gmod::new_loop();
+  gmod::add_use(loop, gmod::FORWARD, line);
+  auto flipped = gmod::new_loop();
+  gmod::add_use(flipped, gmod::REVERSE, line);
+  assert(gmod::hash_closure(loop) != gmod::hash_closure(flipped));
+
+  gmod::ClosureCache cache;
+  int nbuilt = 0;
+  auto build = [&]() {
+    ++nbuilt;
+    return fastener(.25);
+  };
+  auto first = gmod::get_or_build(cache, 42, build);
+  auto second = gmod::get_or_build(cache, 42, build);
+  assert(nbuilt == 1 && cache.hits == 1 && cache.misses == 1);
+  assert(first != second);
+  assert(gmod::hash_closure(first) == gmod::hash_closure(second));
+  assert(gmod::hash_closure(second) == gmod::hash_closure(a));
+  auto key = gmod::remember_closure(cache, a);
+  assert(key == gmod::hash_closure(a));
+  auto recalled = gmod::recall_closure(cache, key);
+  assert(recalled && gmod::hash_closure(recalled) == key);
+  assert(!gmod::recall_closure(cache, key + 1));
+}
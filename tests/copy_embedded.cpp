@@ -0,0 +1,17 @@
+#include <gmodel.hpp>
+#include <minidiff.hpp>
+
+int main()
+{
+  auto c = gmod::new_cube(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1});
+  auto l = gmod::new_line4(gmod::Vector{.25,.5,.5}, gmod::Vector{.75,.5,.5});
+  gmod::embed(c, l);
+  auto copies = gmod::copy_closures(c, 2);
+  gmod::transform_closure(copies[1], gmod::identity_matrix(),
+      gmod::Vector{2,0,0});
+  prevent_regression(copies[1], "copy_embedded");
+}
@@ -0,0 +1,36 @@
+#include <gmodel.hpp>
+#include <atomic>
+#include <cassert>
+#include <thread>
+
+/* a million nested groups would overflow the stack
+   if destruction recursed once per level. another thread creating
+   and destroying objects meanwhile does not change the count. */
+
+int main()
+{
+  int const depth = 1000 * 1000;
+  auto top = gmod::new_group();
+  auto inner = top;
+  for (int i = 0; i < depth; ++i) {
+    auto g = gmod::new_group();
+    gmod::add_to_group(inner, g);
+    inner = g;
+  }
+  inner.reset();
+  std::atomic<bool> done(false);
+  std::thread churn([&]() {
+    while (!done) {
+      gmod::new_cube(
+          gmod::Vector{0,0,0},
+          gmod::Vector{1,0,0},
+          gmod::Vector{0,1,0},
+          gmod::Vector{0,0,1});
+    }
+  });
+  auto released = gmod::release_closure(top);
+  done = true;
+  churn.join();
+  assert(released == depth + 1);
+  assert(top == nullptr);
+}
@@ -0,0 +1,30 @@
+#include <gmodel.hpp>
+#include <minidiff.hpp>
+#include <cassert>
+
+int main()
+{
+  /* push the global ids well away from 1 */
+  for (int i = 0; i < 1000; ++i) gmod::new_point();
+  auto c = gmod::new_cube(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1});
+  auto b = gmod::new_ball(
+      gmod::Vector{.5,.5,.5},
+      gmod::Vector{0,0,1},
+      gmod::Vector{.25,0,0});
+  gmod::insert_into(c, b);
+  auto l = gmod::new_line4(gmod::Vector{.1,.1,.1}, gmod::Vector{.1,.1,.2});
+  gmod::embed(c, l);
+  gmod::GeoOptions options;
+  options.dense_ids = true;
+  prevent_regression2(c, "dense_ids", options);
+  auto map = gmod::write_closure_to_geo2(c, "dense_ids_map.geo", options);
+  assert(map.objects.size() == map.ids.size());
+  for (std::size_t i = 0; i < map.objects.size(); ++i) {
+    if (map.objects[i] == c) assert(map.ids[i] == 1);
+    assert(map.ids[i] >= 1 && map.ids[i] < 1000);
+  }
+}
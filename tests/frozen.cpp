@@ -0,0 +1,71 @@
+#include <gmodel.hpp>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+/* exports a model through both the object graph and its frozen
+   snapshot and checks that the files come out the same */
+
+static std::string slurp(char const* filename) {
+  std::string s;
+  FILE* f = fopen(filename, "r");
+  assert(f);
+  int c;
+  while ((c = fgetc(f)) != EOF) s.push_back(char(c));
+  fclose(f);
+  return s;
+}
+
+int main()
+{
+  auto c = gmod::new_cube(
+      gmod::Vector{0,0,0},
+      gmod::Vector{4,0,0},
+      gmod::Vector{0,4,0},
+      gmod::Vector{0,0,4});
+  auto b = gmod::new_ball(
+      gmod::Vector{2,2,2},
+      gmod::Vector{0,0,1},
+      gmod::Vector{1,0,0});
+  gmod::insert_into(c, b);
+  auto s = gmod::new_spline3({{0,0,6},{1,0.5,6},{2,-0.5,6},{3,0,6}});
+  auto e = gmod::new_ellipse3(gmod::Vector{0,0,8},
+      gmod::Vector{2,0,0}, gmod::Vector{0,1,0});
+  auto l = gmod::new_line4(gmod::Vector{1,1,1}, gmod::Vector{1,1,3});
+  gmod::embed(c, l);
+  auto g = gmod::new_group();
+  gmod::add_to_group(g, c);
+  gmod::add_to_group(g, s);
+  gmod::add_to_group(g, e);
+  auto model = gmod::freeze(g);
+  auto root = int(model.types.size()) - 1;
+  assert(model.ids[std::size_t(root)] == int(g->id));
+  auto closure = gmod::get_closure(g, false, true);
+  auto fclosure = gmod::get_closure(model, root, false, true);
+  assert(closure.size() == fclosure.size());
+  for (std::size_t i = 0; i < closure.size(); ++i)
+    assert(int(closure[i]->id) == model.ids[std::size_t(fclosure[i])]);
+  for (int d = 0; d <= 3; ++d)
+    assert(gmod::count_of_dim(closure, d) ==
+           gmod::count_of_dim(model, fclosure, d));
+  for (std::size_t i = 0; i < closure.size(); ++i) {
+    auto type = closure[i]->type;
+    if (type != gmod::LINE && type != gmod::ARC) continue;
+    for (double u : {0.0, 0.3, 1.0}) {
+      auto a = gmod::eval(closure[i], &u);
+      auto b2 = gmod::eval(model, fclosure[i], &u);
+      assert(std::fabs(a.x - b2.x) + std::fabs(a.y - b2.y) +
+             std::fabs(a.z - b2.z) == 0.0);
+    }
+  }
+  gmod::write_closure_to_geo(g, "frozen_objects.geo");
+  gmod::write_closure_to_geo(model, "frozen_model.geo");
+  assert(slurp("frozen_objects.geo") == slurp("frozen_model.geo"));
+  gmod::write_closure_to_dmg(g, "frozen_objects.dmg");
+  gmod::write_closure_to_dmg(model, "frozen_model.dmg");
+  assert(slurp("frozen_objects.dmg") == slurp("frozen_model.dmg"));
+  auto copy = gmod::copy_closure(g);
+  assert(gmod::get_closure(copy, true, true).size() ==
+         gmod::get_closure(g, true, true).size());
+}
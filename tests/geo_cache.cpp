@@ -0,0 +1,61 @@
+#include <gmodel.hpp>
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+/* writing through a GeoCache must give the same file as a plain
+   write, while only formatting the objects that changed */
+
+static std::string slurp(char const* filename) {
+  std::string s;
+  FILE* f = fopen(filename, "r");
+  assert(f);
+  int c;
+  while ((c = fgetc(f)) != EOF) s.push_back(char(c));
+  fclose(f);
+  return s;
+}
+
+static void check(gmod::ObjPtr const& model, gmod::GeoCache& cache) {
+  gmod::write_closure_to_geo(model, "geo_cache_plain.geo");
+  gmod::write_closure_to_geo(model, "geo_cache.geo", cache);
+  assert(slurp("geo_cache.geo") == slurp("geo_cache_plain.geo"));
+}
+
+int main()
+{
+  auto c = gmod::new_cube(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1});
+  gmod::GeoCache cache;
+  check(c, cache);
+  auto nobjs = int(gmod::get_closure(c, true, true).size());
+  assert(cache.nformatted == nobjs);
+  check(c, cache);
+  assert(cache.nformatted == 0);
+  /* a point moved behind the library's back is still noticed */
+  auto p = gmod::edge_point(
+      gmod::face_loop(gmod::get_cube_face(c, gmod::TOP))->used[0].obj, 0);
+  p->pos.z = 1.5;
+  check(c, cache);
+  assert(cache.nformatted == 1);
+  auto b = gmod::new_ball(
+      gmod::Vector{.5,.5,.5},
+      gmod::Vector{0,0,1},
+      gmod::Vector{.25,0,0});
+  auto nshell = int(
+      gmod::get_closure(gmod::volume_shell(b), true, true).size());
+  gmod::insert_into(c, b);
+  check(c, cache);
+  /* the ball's shell, plus the cube volume which now uses it */
+  assert(cache.nformatted == nshell + 1);
+  gmod::transform_closure(b, gmod::identity_matrix(),
+      gmod::Vector{.1,0,0});
+  check(c, cache);
+  assert(cache.nformatted == int(gmod::filter_points(
+      gmod::get_closure(b, true, true)).size()));
+  assert(int(cache.entries.size()) ==
+         int(gmod::get_closure(c, true, true).size()));
+}
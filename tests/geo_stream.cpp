@@ -0,0 +1,79 @@
+#include <gmodel.hpp>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+/* streaming a whole model at once must give the same file as
+   write_closure_to_geo, and streaming it piece by piece must write
+   every object exactly once and let go of what was written */
+
+static std::string slurp(char const* filename) {
+  std::string s;
+  FILE* f = fopen(filename, "r");
+  assert(f);
+  int c;
+  while ((c = fgetc(f)) != EOF) s.push_back(char(c));
+  fclose(f);
+  return s;
+}
+
+static int count_lines(std::string const& text, char const* prefix) {
+  int n = 0;
+  auto len = strlen(prefix);
+  std::size_t i = 0;
+  while (i < text.size()) {
+    if (text.compare(i, len, prefix) == 0) ++n;
+    auto end = text.find('\n', i);
+    if (end == std::string::npos) break;
+    i = end + 1;
+  }
+  return n;
+}
+
+static gmod::ObjPtr unit_cube(double x) {
+  return gmod::new_cube(
+      gmod::Vector{x,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1});
+}
+
+int main()
+{
+  auto c = unit_cube(0);
+  gmod::insert_into(c, gmod::new_ball(
+      gmod::Vector{.5,.5,.5},
+      gmod::Vector{0,0,1},
+      gmod::Vector{.25,0,0}));
+  gmod::write_closure_to_geo(c, "geo_stream_whole_gold.geo");
+  auto whole = gmod::open_geo_stream("geo_stream_whole.geo");
+  gmod::close_geo_stream(whole, c);
+  assert(slurp("geo_stream_whole.geo") == slurp("geo_stream_whole_gold.geo"));
+  assert(c->used.empty());
+
+  auto group = gmod::new_group();
+  auto stream = gmod::open_geo_stream("geo_stream_pieces.geo");
+  std::weak_ptr<gmod::Object> first_point;
+  for (int i = 0; i < 3; ++i) {
+    auto cube = unit_cube(2 * i);
+    if (i == 0) {
+      first_point = gmod::edge_point(
+          gmod::face_loop(gmod::get_cube_face(cube, gmod::BOTTOM))->used[0].obj,
+          0);
+    }
+    gmod::stream_closure(stream, cube);
+    assert(cube->flags & gmod::OBJECT_STREAMED);
+    gmod::add_to_group(group, cube);
+  }
+  assert(first_point.expired());
+  gmod::close_geo_stream(stream, group);
+  auto text = slurp("geo_stream_pieces.geo");
+  assert(count_lines(text, "Point(") == 3 * 8);
+  assert(count_lines(text, "Line(") == 3 * 12);
+  assert(count_lines(text, "Line Loop(") == 3 * 6);
+  assert(count_lines(text, "Plane Surface(") == 3 * 6);
+  assert(count_lines(text, "Volume(") == 3);
+  assert(count_lines(text, "Physical Point(") == 3 * 8);
+  assert(count_lines(text, "Physical Volume(") == 3);
+}
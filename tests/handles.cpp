@@ -0,0 +1,25 @@
+#include <gmodel.hpp>
+#include <cassert>
+
+/* the handle overloads must see the same points as the ObjPtr ones */
+
+int main()
+{
+  auto arc = gmod::new_arc2(gmod::new_point2({1,0,0}),
+      gmod::new_point2({0,0,0}), gmod::new_point2({0,1,0}));
+  gmod::ObjHandle h(arc);
+  assert(h.get() == arc.get());
+  assert(gmod::edge_point(h, 0).get() == gmod::edge_point(arc, 0).get());
+  assert(gmod::edge_point(h, 1).get() == gmod::edge_point(arc, 1).get());
+  assert(gmod::arc_center(h).get() == gmod::arc_center(arc).get());
+  gmod::PointHandle p = gmod::edge_point(h, 1);
+  assert(p->pos.y == 1.0);
+  gmod::ObjHandle back = p;
+  assert(back->type == gmod::POINT);
+  auto pp = gmod::object_cast<gmod::Point>(arc->used[0].obj);
+  assert(pp->pos.x == 1.0);
+  double u = 0.5;
+  auto a = gmod::eval(arc, &u);
+  auto b = gmod::eval(h, &u);
+  assert(a.x == b.x && a.y == b.y && a.z == b.z);
+}
@@ -0,0 +1,70 @@
+#include <gmodel.hpp>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <set>
+
+/* the spline_shape model, with the interior spline point kept inline.
+   the .geo output must still declare every point exactly once. */
+
+static gmod::ObjPtr shape() {
+  auto a = gmod::new_point2(gmod::Vector{0,0,0});
+  auto b = gmod::new_point2(gmod::Vector{1,0,0});
+  auto c = gmod::new_point2(gmod::Vector{1,1,0});
+  auto e = gmod::new_point2(gmod::Vector{0,1,0});
+  auto l = gmod::new_loop();
+  gmod::add_use(l, gmod::FORWARD, gmod::new_line2(a,b));
+  gmod::add_use(l, gmod::FORWARD, gmod::new_line2(b,c));
+  auto interior = std::vector<gmod::Vector>({gmod::Vector{0.5,1.5,0}});
+  gmod::add_use(l, gmod::FORWARD, gmod::new_spline5(c, interior, e));
+  gmod::add_use(l, gmod::FORWARD, gmod::new_line2(e,a));
+  auto f = gmod::new_plane2(l);
+  return gmod::extrude_face(f, gmod::Vector{0,0,1}).middle;
+}
+
+/* the ids of all Point lines, asserting none is repeated */
+static std::set<int> point_ids(char const* filename) {
+  std::set<int> ids;
+  auto f = fopen(filename, "r");
+  assert(f);
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    int id;
+    if (sscanf(line, "Point(%d)", &id) != 1) continue;
+    assert(!ids.count(id));
+    ids.insert(id);
+  }
+  fclose(f);
+  remove(filename);
+  return ids;
+}
+
+int main()
+{
+  auto r = shape();
+  auto stats = gmod::model_stats(r);
+  assert(stats.count_by_type[gmod::POINT] == 8);
+  assert(stats.count_by_type[gmod::SPLINE] == 2);
+  assert(stats.ninline_points == 2);
+  gmod::write_closure_to_geo(r, "inline_spline.geo");
+  assert(point_ids("inline_spline.geo").size() == 10);
+  /* copies hash the same and keep their points inline */
+  auto copy = gmod::copy_closure(r);
+  assert(gmod::hash_closure(copy) == gmod::hash_closure(r));
+  assert(gmod::model_stats(copy).ninline_points == 2);
+  gmod::transform_closure(copy, gmod::identity_matrix(),
+      gmod::Vector{0,0,1});
+  assert(gmod::hash_closure(copy) != gmod::hash_closure(r));
+  auto group = gmod::new_group();
+  gmod::add_to_group(group, r);
+  gmod::add_to_group(group, copy);
+  gmod::write_closure_to_geo(group, "inline_spline.geo");
+  assert(point_ids("inline_spline.geo").size() == 20);
+  /* dense ids number the inline points along with the others */
+  gmod::GeoOptions options;
+  options.dense_ids = true;
+  gmod::write_closure_to_geo2(r, "inline_spline.geo", options);
+  auto ids = point_ids("inline_spline.geo");
+  assert(ids.size() == 10);
+  assert(*ids.begin() == 1 && *ids.rbegin() == 10);
+}
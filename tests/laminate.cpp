@@ -0,0 +1,18 @@
+#include <gmodel.hpp>
+#include <minidiff.hpp>
+
+int main()
+{
+  auto base = gmod::new_square(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0});
+  std::vector<gmod::Transform> plies;
+  for (int i = 0; i < 3; ++i) {
+    plies.push_back([](gmod::Vector a){return a + gmod::Vector{0,0,0.1};});
+  }
+  auto layers = gmod::extrude_face_layers(base, plies);
+  auto laminate = gmod::new_group();
+  for (auto layer : layers) gmod::add_to_group(laminate, layer.middle);
+  prevent_regression(laminate, "laminate");
+}
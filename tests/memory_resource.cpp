@@ -0,0 +1,75 @@
+#include <gmodel.hpp>
+#include <cassert>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
+/* everything built while a resource is installed, including copies
+   and the work done by extrusion's worker threads, comes from that
+   resource and goes back to it */
+
+class CountingResource : public gmod::MemoryResource {
+ public:
+  CountingResource() : nallocated(0), nfreed(0) {}
+  void* allocate(std::size_t bytes, std::size_t) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++nallocated;
+    auto p = std::malloc(bytes);
+    blocks[static_cast<char const*>(p)] = bytes;
+    return p;
+  }
+  void deallocate(void* p, std::size_t, std::size_t) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++nfreed;
+    blocks.erase(static_cast<char const*>(p));
+    std::free(p);
+  }
+  bool owns(void const* p) {
+    /* the last block starting at or before p */
+    auto c = static_cast<char const*>(p);
+    auto it = blocks.upper_bound(c);
+    if (it == blocks.begin()) return false;
+    --it;
+    return c < it->first + it->second;
+  }
+  long nallocated;
+  long nfreed;
+
+ private:
+  std::mutex mutex;
+  /* the start and size of each live block, sorted by start */
+  std::map<char const*, std::size_t> blocks;
+};
+
+int main()
+{
+  CountingResource resource;
+  gmod::set_num_threads(4);
+  gmod::ObjPtr model;
+  {
+    gmod::ScopedMemoryResource scope(&resource);
+    assert(gmod::get_memory_resource() == &resource);
+    auto faces = gmod::new_group();
+    for (int i = 0; i < 30; ++i)
+    for (int j = 0; j < 30; ++j) {
+      gmod::add_to_group(faces, gmod::new_square(
+            gmod::Vector{2.0 * i, 2.0 * j, 0},
+            gmod::Vector{1,0,0}, gmod::Vector{0,1,0}));
+    }
+    auto ext = gmod::extrude_face_group(faces,
+        [](gmod::Vector a) { return a + gmod::Vector{0,0,1}; });
+    model = gmod::new_group();
+    gmod::add_to_group(model, ext.middle);
+    gmod::add_to_group(model, gmod::copy_closure(ext.middle));
+  }
+  assert(gmod::get_memory_resource() == nullptr);
+  auto outside = gmod::new_point();
+  assert(!resource.owns(outside.get()));
+  for (auto const& obj : gmod::get_closure(model, true, true)) {
+    assert(resource.owns(obj.get()));
+    if (!obj->used.is_inline()) assert(resource.owns(obj->used.data()));
+  }
+  assert(resource.nallocated > 0);
+  model.reset();
+  assert(resource.nfreed == resource.nallocated);
+}
@@ -27,3 +27,16 @@ void prevent_regression(gmod::ObjPtr model, std::string const& name) {
   assert(are_same(geo_name, gold_geo_name));
   assert(are_same(dmg_name, gold_dmg_name));
 }
+
+void prevent_regression2(gmod::ObjPtr model, std::string const& name,
+    gmod::GeoOptions const& options) {
+  std::string gold_name = name + "_gold";
+  std::string geo_name = name + ".geo";
+  std::string dmg_name = name + ".dmg";
+  std::string gold_geo_name = gold_name + ".geo";
+  std::string gold_dmg_name = gold_name + ".dmg";
+  gmod::write_closure_to_geo2(model, geo_name.c_str(), options);
+  gmod::write_closure_to_dmg2(model, dmg_name.c_str(), options);
+  assert(are_same(geo_name, gold_geo_name));
+  assert(are_same(dmg_name, gold_dmg_name));
+}
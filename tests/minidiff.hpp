@@ -5,5 +5,8 @@
 #include <string>
 
 void prevent_regression(gmod::ObjPtr model, std::string const& name);
+/* same, but written through write_closure_to_geo2/dmg2 */
+void prevent_regression2(gmod::ObjPtr model, std::string const& name,
+    gmod::GeoOptions const& options);
 
 #endif
@@ -0,0 +1,36 @@
+#include <gmodel.hpp>
+#include <cassert>
+
+int main()
+{
+  auto before = gmod::live_stats();
+  auto c = gmod::new_cube(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1});
+  auto stats = gmod::model_stats(c);
+  assert(stats.nobjects == 34);
+  assert(stats.count_by_type[gmod::POINT] == 8);
+  assert(stats.count_by_type[gmod::LINE] == 12);
+  assert(stats.count_by_type[gmod::LOOP] == 6);
+  assert(stats.count_by_type[gmod::PLANE] == 6);
+  assert(stats.count_by_type[gmod::SHELL] == 1);
+  assert(stats.count_by_dim[0] == 8);
+  assert(stats.count_by_dim[1] == 12);
+  assert(stats.count_by_dim[2] == 6);
+  assert(stats.count_by_dim[3] == 1);
+  /* 2 per line, 4 per loop, 1 per plane, 6 in the shell, 1 volume */
+  assert(stats.nuses == 24 + 24 + 6 + 6 + 1);
+  assert(stats.nhelpers == 0 && stats.nembedded == 0);
+  /* the loops and the shell outgrow the inline storage */
+  assert(stats.nspilled == 7);
+  assert(stats.bytes >= 34 * sizeof(gmod::Object));
+  auto live = gmod::live_stats();
+  assert(live.nobjects - before.nobjects == 34);
+  assert(live.count_by_type[gmod::POINT] - before.count_by_type[gmod::POINT]
+      == 8);
+  c.reset();
+  auto after = gmod::live_stats();
+  assert(after.nobjects == before.nobjects);
+}
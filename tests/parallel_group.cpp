@@ -0,0 +1,49 @@
+#include <gmodel.hpp>
+#include <cassert>
+
+/* extrudes a tiled cross section with one thread and with several,
+   and checks that both models match up to a constant id offset */
+
+static gmod::ObjPtr extrude_tiles(int threads) {
+  gmod::set_num_threads(threads);
+  auto tiles = gmod::new_group();
+  auto grid = gmod::new_block_grid(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1},
+      40, 40, 1);
+  for (auto use : grid->used) {
+    gmod::add_to_group(tiles, gmod::get_cube_face(use.obj, gmod::TOP));
+  }
+  return gmod::extrude_face_group(tiles,
+      [](gmod::Vector a){return a + gmod::Vector{0,0,0.5};}).middle;
+}
+
+int main()
+{
+  /* serial unless asked otherwise */
+  assert(gmod::get_num_threads() == 1);
+  auto serial = gmod::get_closure(extrude_tiles(1), true, true);
+  auto parallel = gmod::get_closure(extrude_tiles(4), true, true);
+  assert(serial.size() == parallel.size());
+  int offset = parallel.back()->id - serial.back()->id;
+  for (std::size_t i = 0; i < serial.size(); ++i) {
+    auto a = serial[i];
+    auto b = parallel[i];
+    assert(a->type == b->type);
+    assert(b->id - a->id == offset);
+    assert(a->used.size() == b->used.size());
+    for (std::size_t j = 0; j < a->used.size(); ++j) {
+      assert(a->used[j].dir == b->used[j].dir);
+      assert(b->used[j].obj->id - a->used[j].obj->id == offset);
+    }
+    if (a->type == gmod::POINT) {
+      auto pa = std::dynamic_pointer_cast<gmod::Point>(a);
+      auto pb = std::dynamic_pointer_cast<gmod::Point>(b);
+      assert(pa->pos.x == pb->pos.x);
+      assert(pa->pos.y == pb->pos.y);
+      assert(pa->pos.z == pb->pos.z);
+    }
+  }
+}
@@ -0,0 +1,23 @@
+#include <gmodel.hpp>
+#include <minidiff.hpp>
+
+int main()
+{
+  auto model = gmod::new_group();
+  auto square = gmod::new_square(
+      gmod::Vector{0,0,0}, gmod::Vector{0,1,0}, gmod::Vector{0,0,1});
+  auto shifted = gmod::copy_periodic(square, gmod::identity_matrix(),
+      gmod::Vector{1,0,0});
+  /* an exact quarter turn about z, onto the plane y = 0 */
+  auto quarter = gmod::Matrix{
+      gmod::Vector{0,1,0}, gmod::Vector{-1,0,0}, gmod::Vector{0,0,1}};
+  auto turned = gmod::copy_periodic(square, quarter, gmod::Vector{0,0,0});
+  gmod::add_to_group(model, square);
+  gmod::add_to_group(model, shifted.copy);
+  gmod::add_to_group(model, turned.copy);
+  gmod::GeoOptions options;
+  options.dense_ids = true;
+  options.periodic.push_back(shifted);
+  options.periodic.push_back(turned);
+  prevent_regression2(model, "periodic", options);
+}
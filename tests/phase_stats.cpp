@@ -0,0 +1,60 @@
+#include <gmodel.hpp>
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+/* with GMOD_PROFILE the entry points used here show up in the phase
+   totals and the trace, and without it everything stays empty */
+
+static long calls_of(char const* name) {
+  for (auto const& stat : gmod::get_phase_stats())
+    if (std::string(stat.name) == name) return stat.calls;
+  return -1;
+}
+
+int main()
+{
+  gmod::set_tracing(true);
+  auto disk = gmod::new_disk(gmod::Vector{0,0,0}, gmod::Vector{0,0,1},
+      gmod::Vector{1,0,0});
+  auto cylinder = gmod::extrude_face(disk, gmod::Vector{0,0,1}).middle;
+  auto copy = gmod::copy_closure(cylinder);
+  gmod::transform_closure(copy, gmod::identity_matrix(),
+      gmod::Vector{3,0,0});
+  gmod::write_closure_to_geo(copy, "phase_stats.geo");
+  gmod::write_chrome_trace("phase_stats.json");
+  gmod::print_phase_stats(stdout);
+  FILE* f = fopen("phase_stats.json", "r");
+  assert(f);
+  std::string trace;
+  int c;
+  while ((c = fgetc(f)) != EOF) trace.push_back(char(c));
+  fclose(f);
+  assert(trace.compare(0, 15, "{\"traceEvents\":") == 0);
+  if (gmod::profiling_enabled()) {
+    /* the nested loop, edge and point extrusions are not counted */
+    assert(calls_of("extrude") == 1);
+    assert(calls_of("copy") == 1);
+    assert(calls_of("transform") == 1);
+    assert(calls_of("write_geo") == 1);
+    assert(calls_of("get_closure") > 0);
+    assert(trace.find("\"name\":\"extrude\"") != std::string::npos);
+    gmod::reset_phase_stats();
+    assert(calls_of("extrude") == 0);
+    /* nor are the extrusions done by worker threads */
+    gmod::set_num_threads(4);
+    auto faces = gmod::new_group();
+    for (int i = 0; i < 30; ++i)
+    for (int j = 0; j < 30; ++j) {
+      gmod::add_to_group(faces, gmod::new_square(
+            gmod::Vector{2.0 * i, 2.0 * j, 0},
+            gmod::Vector{1,0,0}, gmod::Vector{0,1,0}));
+    }
+    gmod::reset_phase_stats();
+    gmod::extrude_face_group(faces,
+        [](gmod::Vector a) { return a + gmod::Vector{0,0,1}; });
+    assert(calls_of("extrude") == 1);
+  } else {
+    for (auto const& stat : gmod::get_phase_stats()) assert(stat.calls == 0);
+  }
+}
@@ -0,0 +1,59 @@
+#include <gmodel.hpp>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+/* read_coords parses numbers itself, so check it against strtod on
+   every spelling it accepts */
+
+static char const* const text =
+    "% a comment\n"
+    "# another one\n"
+    "\n"
+    "  1.0000000 0.0000000\n"
+    "0.9900000\t-.0012100 \r\n"
+    "1e-3, 2.5E+2, -7\n"
+    "0.1 0.2 0.3\n"
+    "123456789012345678 1.7976931348623157e308\n"
+    "5e-324 -0.0";
+
+int main(int argc, char** argv)
+{
+  assert(argc == 2);
+  auto f = fopen("read_coords.dat", "w");
+  assert(f);
+  fputs(text, f);
+  fclose(f);
+  auto pts = gmod::read_coords("read_coords.dat");
+  remove("read_coords.dat");
+  assert(pts.size() == 6);
+  assert(pts[0].x == 1 && pts[0].y == 0 && pts[0].z == 0);
+  assert(pts[1].x == strtod("0.99", nullptr));
+  assert(pts[1].y == strtod("-.00121", nullptr));
+  assert(pts[2].x == strtod("1e-3", nullptr));
+  assert(pts[2].y == 250 && pts[2].z == -7);
+  assert(pts[3].x == strtod("0.1", nullptr));
+  assert(pts[3].y == strtod("0.2", nullptr));
+  assert(pts[3].z == strtod("0.3", nullptr));
+  assert(pts[4].x == strtod("123456789012345678", nullptr));
+  assert(pts[4].y == strtod("1.7976931348623157e308", nullptr));
+  assert(pts[5].x == strtod("5e-324", nullptr));
+  /* the airfoil: a comment line, then 49 points above y=0 (the
+     leading edge among them), 48 below and the trailing edge at both
+     ends */
+  auto airfoil = gmod::read_coords(argv[1]);
+  assert(airfoil.size() == 99);
+  auto chains = gmod::split_profile(airfoil);
+  assert(chains.lower.size() == 2 + 48);
+  assert(chains.upper.size() == 2 + 48);
+  assert(chains.lower.front().x == 0 && chains.lower.back().x == 1);
+  assert(chains.upper.front().x == 1 && chains.upper.back().x == 0);
+  for (std::size_t i = 1; i + 1 < chains.lower.size(); ++i)
+    assert(chains.lower[i].y < 0);
+  for (std::size_t i = 1; i + 1 < chains.upper.size(); ++i)
+    assert(chains.upper[i].y > 0);
+  auto loop = gmod::new_profile_loop(chains);
+  assert(loop->used.size() == 2);
+  assert(gmod::edge_point(loop->used[0].obj, 0) ==
+      gmod::edge_point(loop->used[1].obj, 1));
+}
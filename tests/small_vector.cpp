@@ -0,0 +1,37 @@
+#include <gmodel.hpp>
+#include <cassert>
+
+/* checks that Object::used keeps its elements through the switch
+   from inline storage to the heap, through copies and moves, and
+   when one of them is pushed onto the end */
+
+int main()
+{
+  auto pts = gmod::new_points({{0,0,0},{1,0,0},{1,1,0},{0,1,0},{0,2,0},
+      {-1,2,0}});
+  auto line = gmod::new_line2(pts[0], pts[1]);
+  assert(line->used.size() == 2 && line->used.is_inline());
+  assert(line->helpers.empty() && line->helpers.is_inline());
+  auto chain = gmod::new_loop();
+  for (std::size_t i = 0; i + 1 < pts.size(); ++i)
+    gmod::add_use(chain, gmod::FORWARD, gmod::new_line2(pts[i], pts[i + 1]));
+  assert(chain->used.size() == 5 && !chain->used.is_inline());
+  for (std::size_t i = 0; i < chain->used.size(); ++i)
+    assert(gmod::edge_point(chain->used[i].obj, 0) == pts[i]);
+  auto copy = chain->used;
+  assert(copy.size() == 5 && copy[4].obj == chain->used[4].obj);
+  auto moved = std::move(copy);
+  assert(copy.empty() && copy.is_inline());
+  assert(moved.size() == 5 && moved[0].obj == chain->used[0].obj);
+  auto inline_copy = line->used;
+  auto inline_moved = std::move(inline_copy);
+  assert(inline_copy.empty() && inline_moved.size() == 2);
+  moved = inline_moved;
+  assert(moved.size() == 2 && moved[1].obj == line->used[1].obj);
+  /* an element moved onto the end of its own full vector */
+  moved.push_back(std::move(moved[0]));
+  assert(moved.size() == 3 && moved[2].obj == line->used[0].obj);
+  assert(moved[0].obj == nullptr);
+  moved.clear();
+  assert(moved.empty());
+}
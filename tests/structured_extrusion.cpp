@@ -0,0 +1,56 @@
+#include <gmodel.hpp>
+#include <minidiff.hpp>
+#include <cassert>
+#include <fstream>
+#include <sstream>
+
+static std::string read_file(char const* filename) {
+  std::ifstream file(filename);
+  std::stringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+
+int main()
+{
+  auto base = gmod::new_square(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0});
+  std::vector<gmod::Transform> plies;
+  for (int i = 0; i < 3; ++i) {
+    plies.push_back([](gmod::Vector a){return a + gmod::Vector{0,0,0.1};});
+  }
+  auto layers = gmod::extrude_face_layers(base, plies);
+  auto laminate = gmod::new_group();
+  for (auto layer : layers) gmod::add_to_group(laminate, layer.middle);
+  gmod::GeoOptions options;
+  options.dense_ids = true;
+  options.structured_extrusions = true;
+  prevent_regression2(laminate, "structured_extrusion", options);
+  /* neighbours in a face group share sides, which separate Extrude
+     commands cannot express, so they are written as before */
+  auto grid = gmod::new_block_grid(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,1},
+      2, 1, 1);
+  auto faces = gmod::new_group();
+  for (auto use : grid->used)
+    gmod::add_to_group(faces, gmod::get_cube_face(use.obj, gmod::TOP));
+  auto blocks = gmod::extrude_face_group(faces,
+      [](gmod::Vector a){return a + gmod::Vector{0,0,1};}).middle;
+  gmod::write_closure_to_geo2(blocks, "structured_blocks.geo", options);
+  options.structured_extrusions = false;
+  gmod::write_closure_to_geo2(blocks, "unstructured_blocks.geo", options);
+  assert(read_file("structured_blocks.geo") ==
+         read_file("unstructured_blocks.geo"));
+  /* other transforms are not recorded as extrusions */
+  auto twisted = gmod::extrude_face2(base, [](gmod::Vector a) {
+    return gmod::Vector{-a.y, a.x, a.z + 1};
+  }).middle;
+  assert(!gmod::is_extruded_volume(*twisted));
+  assert(gmod::is_extruded_volume(*layers[0].middle));
+  assert(gmod::is_extruded_volume(*gmod::copy_closure(layers[0].middle)));
+}
@@ -0,0 +1,37 @@
+#include <gmodel.hpp>
+#include <minidiff.hpp>
+
+int main()
+{
+  auto model = gmod::new_group();
+  gmod::add_to_group(model, gmod::new_cube(
+      gmod::Vector{0,0,0},
+      gmod::Vector{1,0,0},
+      gmod::Vector{0,1,0},
+      gmod::Vector{0,0,.35}));
+  /* a trapezoid, whose short side gets the node count of the long one */
+  auto base = gmod::new_line4(gmod::Vector{0,0,2}, gmod::Vector{1,0,2});
+  auto narrow = [](gmod::Vector a) {
+    return gmod::Vector{0.25 + 0.5 * a.x, a.y + 1, a.z};
+  };
+  auto left = gmod::extrude_point2(gmod::edge_point(base, 0), narrow);
+  auto right = gmod::extrude_point2(gmod::edge_point(base, 1), narrow);
+  gmod::add_to_group(model,
+      gmod::extrude_edge3(base, narrow, left, right).middle);
+  gmod::add_to_group(model, gmod::new_block_grid(
+      gmod::Vector{3,0,0},
+      gmod::Vector{.5,0,0},
+      gmod::Vector{0,.5,0},
+      gmod::Vector{0,0,.5},
+      2, 1, 1));
+  /* a hole leaves a square with two loops, which is left out */
+  auto holed = gmod::new_square(
+      gmod::Vector{0,0,4}, gmod::Vector{1,0,0}, gmod::Vector{0,1,0});
+  gmod::insert_into(holed, gmod::new_disk(
+      gmod::Vector{.5,.5,4}, gmod::Vector{0,0,1}, gmod::Vector{.25,0,0}));
+  gmod::add_to_group(model, holed);
+  gmod::GeoOptions options;
+  options.dense_ids = true;
+  options.transfinite = true;
+  prevent_regression2(model, "transfinite", options);
+}
@@ -0,0 +1,43 @@
+#include <gmodel.hpp>
+#include <cassert>
+
+/* shuffles the edges of two squares and a dangling chain together
+   and checks that unscramble_loops pulls them back apart */
+
+static void check_closed(gmod::ObjPtr loop) {
+  auto n = loop->used.size();
+  for (std::size_t i = 0; i < n; ++i) {
+    auto a = loop->used[i];
+    auto b = loop->used[(i + 1) % n];
+    assert(gmod::edge_point(a.obj, 1 - a.dir) == gmod::edge_point(b.obj, b.dir));
+  }
+}
+
+int main()
+{
+  auto a = gmod::new_polyline2({{0,0,0},{1,0,0},{1,1,0},{0,1,0}});
+  auto b = gmod::new_polyline2({{2,0,0},{3,0,0},{3,1,0},{2,1,0}});
+  auto p = gmod::new_points({{5,0,0},{6,0,0},{7,0,0}});
+  auto scrambled = gmod::new_loop();
+  gmod::add_use(scrambled, gmod::REVERSE, b->used[2].obj);
+  gmod::add_use(scrambled, gmod::FORWARD, a->used[0].obj);
+  gmod::add_use(scrambled, gmod::FORWARD, gmod::new_line2(p[1], p[2]));
+  gmod::add_use(scrambled, gmod::FORWARD, b->used[0].obj);
+  gmod::add_use(scrambled, gmod::FORWARD, a->used[3].obj);
+  gmod::add_use(scrambled, gmod::FORWARD, a->used[1].obj);
+  gmod::add_use(scrambled, gmod::FORWARD, b->used[3].obj);
+  gmod::add_use(scrambled, gmod::FORWARD, a->used[2].obj);
+  gmod::add_use(scrambled, gmod::FORWARD, b->used[1].obj);
+  gmod::add_use(scrambled, gmod::FORWARD, gmod::new_line2(p[0], p[1]));
+  std::vector<gmod::ObjPtr> open;
+  auto loops = gmod::unscramble_loops(scrambled, &open);
+  assert(loops.size() == 2);
+  assert(loops[0] == scrambled);
+  assert(loops[0]->used.size() == 4);
+  assert(loops[1]->used.size() == 4);
+  check_closed(loops[0]);
+  check_closed(loops[1]);
+  assert(open.size() == 1);
+  assert(open[0]->used.size() == 2);
+  assert(gmod::edge_point(open[0]->used[0].obj, 0) == p[0]);
+}